@@ -0,0 +1,229 @@
+#include "AssetLoader.h"
+
+#include <iostream>
+#include <set>
+#include <vector>
+
+#include "chai3d.h"
+
+#include "GeometryCache.h"
+#include "LevelOfDetail.h"
+#include "StartupTrace.h"
+#include "TextureCache.h"
+
+ThreadPool* AssetLoader::pool = nullptr;
+std::mutex AssetLoader::cacheMutex;
+std::mutex AssetLoader::timingsMutex;
+double AssetLoader::stageSeconds[(int)LoadStage::COUNT] = {};
+
+static const char* stageNames[] = { "read", "mesh parse", "collision tree", "level of detail", "image decode", "entities" };
+
+// Result of loading one mesh on a worker
+struct MeshSlot {
+	std::string filename;
+	unsigned long long hash;
+	chai3d::cMultiMesh* mesh;
+	std::vector<chai3d::cMultiMesh*> levels;
+	bool ok;
+	bool levelsOk;
+};
+
+// Result of decoding one image on a worker
+struct ImageSlot {
+	std::string filename;
+	chai3d::cImagePtr image;
+};
+
+// Sets the budget of a load, counting from empty caches until countCaches is called
+LoadLimit::LoadLimit(double budgetMB) : budgetBytes((size_t)(budgetMB * 1024.0 * 1024.0)), usedBytes(0), overBudget(false), stop(false) {}
+
+// Counts the memory already held by the caches. Call on the thread that owns the caches before loading
+void LoadLimit::countCaches() {
+	addBytes(GeometryCache::getMemoryUsage() + TextureCache::getMemoryUsage());
+}
+
+// Counts an asset that was loaded, stopping the load once over budget. Safe to call from any thread
+void LoadLimit::addBytes(size_t bytes) {
+
+	if ((usedBytes += bytes) > budgetBytes) {
+		overBudget = true;
+		stop = true;
+	}
+}
+
+// Stops the load from another thread
+void LoadLimit::cancel() {
+	stop = true;
+}
+
+// Returns if the load should stop, either cancelled or over budget
+bool LoadLimit::stopped() const {
+	return stop;
+}
+
+// Returns if the load stopped because it went over budget
+bool LoadLimit::isOverBudget() const {
+	return overBudget;
+}
+
+// Returns the memory counted so far
+double LoadLimit::getUsedMB() const {
+	return usedBytes / (1024.0 * 1024.0);
+}
+
+// Returns the flag set when the load should stop, for loops that only take a cancel flag
+const std::atomic<bool>* LoadLimit::getFlag() const {
+	return &stop;
+}
+
+// Loads every mesh and image the world entries use that is not cached yet. With a limit, assets not started when
+// it stops are skipped, and meshes whose levels of detail were not finished are cached without them
+void AssetLoader::prefetch(const std::vector<const rapidjson::Value*>& entities, LoadLimit* limit) {
+
+	// Sets keep the files sorted, which fixes the order results are added in
+	std::set<std::string> meshFiles;
+	std::set<std::string> imageFiles;
+	for (const rapidjson::Value* e : entities) {
+
+		std::string mesh = (*e)["filename"].GetString();
+		if (!GeometryCache::hasPrototype(mesh)) {
+			meshFiles.insert(mesh);
+		}
+		if (e->HasMember("texture")) {
+			std::string image = (*e)["texture"].GetString();
+			if (!TextureCache::hasImage(image)) {
+				imageFiles.insert(image);
+			}
+		}
+	}
+
+	std::vector<MeshSlot> meshes;
+	for (const std::string& f : meshFiles) {
+		meshes.push_back({ f, 0, nullptr, {}, false, false });
+	}
+	std::vector<ImageSlot> images;
+	for (const std::string& f : imageFiles) {
+		images.push_back({ f, nullptr });
+	}
+
+	const std::atomic<bool>* cancel = (limit != nullptr) ? limit->getFlag() : nullptr;
+	auto stopped = [limit] { return limit != nullptr && limit->stopped(); };
+
+	getPool().parallelFor((int)meshes.size(), [&meshes, limit, cancel, &stopped](int i) {
+
+		MeshSlot& slot = meshes[i];
+		chai3d::cPrecisionClock clock;
+		clock.start(true);
+
+		if (!GeometryCache::hashFile(slot.filename, slot.hash)) {
+			return;
+		}
+		{
+			TracePhase phase("mesh parse", slot.filename);
+			slot.mesh = GeometryCache::loadPrototype(slot.filename);
+		}
+		double parsed = clock.getCurrentTimeSeconds();
+		if (stopped()) {
+			delete slot.mesh;
+			slot.mesh = nullptr;
+			return;
+		}
+		{
+			TracePhase phase("collision tree", slot.filename);
+			GeometryCache::buildCollisionTree(slot.mesh);
+		}
+		double built = clock.getCurrentTimeSeconds();
+		slot.ok = true;
+
+		if (!LevelOfDetail::hasLevels(slot.filename)) {
+			TracePhase phase("level of detail", slot.filename);
+			slot.levels = LevelOfDetail::buildLevels(slot.filename, slot.mesh, cancel);
+		}
+		double reduced = clock.getCurrentTimeSeconds();
+		slot.levelsOk = !stopped();
+
+		size_t bytes = GeometryCache::estimateBytes(slot.mesh);
+		for (chai3d::cMultiMesh* level : slot.levels) {
+			bytes += GeometryCache::estimateBytes(level);
+		}
+		if (limit != nullptr) {
+			limit->addBytes(bytes);
+		}
+
+		addTime(LoadStage::MESH_PARSE, parsed);
+		addTime(LoadStage::COLLISION_TREE, built - parsed);
+		addTime(LoadStage::LEVEL_OF_DETAIL, reduced - built);
+	}, cancel);
+
+	getPool().parallelFor((int)images.size(), [&images, limit](int i) {
+
+		chai3d::cPrecisionClock clock;
+		clock.start(true);
+
+		TracePhase phase("image decode", images[i].filename);
+		images[i].image = chai3d::cImage::create();
+		if (!images[i].image->loadFromFile(images[i].filename)) {
+			images[i].image = nullptr;
+		}
+		else if (limit != nullptr) {
+			limit->addBytes(images[i].image->getSizeInBytes());
+		}
+		addTime(LoadStage::IMAGE_DECODE, clock.getCurrentTimeSeconds());
+	}, cancel);
+
+	// Failed assets are left for the caches to report when an entity asks for them
+	for (MeshSlot& slot : meshes) {
+		if (!slot.ok) {
+			continue;
+		}
+		GeometryCache::addPrototype(slot.filename, slot.hash, slot.mesh);
+		if (!slot.levelsOk) {
+			for (chai3d::cMultiMesh* level : slot.levels) {
+				delete level;
+			}
+		}
+		else if (!LevelOfDetail::hasLevels(slot.filename)) {
+			LevelOfDetail::addLevels(slot.filename, slot.levels);
+		}
+	}
+	for (ImageSlot& slot : images) {
+		if (slot.image != nullptr) {
+			TextureCache::addImage(slot.filename, slot.image);
+		}
+	}
+}
+
+// Returns the pool used for loading, started on first use
+ThreadPool& AssetLoader::getPool() {
+
+	if (pool == nullptr) {
+		pool = new ThreadPool(ThreadPool::defaultWorkers());
+	}
+	return *pool;
+}
+
+// Clears the stage timings before loading a level
+void AssetLoader::resetTimings() {
+
+	std::lock_guard<std::mutex> lock(timingsMutex);
+	for (double& s : stageSeconds) {
+		s = 0.0;
+	}
+}
+
+// Adds time spent in a stage. Safe to call from any thread
+void AssetLoader::addTime(LoadStage stage, double seconds) {
+
+	std::lock_guard<std::mutex> lock(timingsMutex);
+	stageSeconds[(int)stage] += seconds;
+}
+
+// Prints the time spent in each stage and the wall time of the whole load
+void AssetLoader::printTimings(double totalSeconds) {
+
+	std::lock_guard<std::mutex> lock(timingsMutex);
+	std::cout << "Level loaded in " << chai3d::cStr(totalSeconds * 1000.0, 1) << " ms on " << getPool().getNumThreads() << " threads (stage times summed over threads):" << std::endl;
+	for (int i = 0; i < (int)LoadStage::COUNT; i++) {
+		std::cout << "  " << stageNames[i] << " " << chai3d::cStr(stageSeconds[i] * 1000.0, 1) << " ms" << std::endl;
+	}
+}
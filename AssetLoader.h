@@ -0,0 +1,70 @@
+#pragma once
+
+#include <rapidjson/document.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// Stages of loading a level, timed separately
+enum class LoadStage {
+	READ,
+	MESH_PARSE,
+	COLLISION_TREE,
+	LEVEL_OF_DETAIL,
+	IMAGE_DECODE,
+	ENTITIES,
+	COUNT
+};
+
+// Limit on a background load, which stops once cancelled or once the assets loaded would take the caches over a
+// memory budget. Loaders check it before each asset and count the memory of each asset they load, so a load stops
+// part way rather than at the end of a level
+class LoadLimit {
+
+public:
+	LoadLimit(double budgetMB);
+
+	void countCaches();
+	void addBytes(size_t bytes);
+	void cancel();
+
+	bool stopped() const;
+	bool isOverBudget() const;
+	double getUsedMB() const;
+	const std::atomic<bool>* getFlag() const;
+
+private:
+	size_t budgetBytes;
+	std::atomic<size_t> usedBytes;
+	std::atomic<bool> overBudget;
+	std::atomic<bool> stop;
+};
+
+// Class that fills the geometry, level of detail and texture caches for a world in parallel. Work for each asset runs
+// on a thread pool into its own slot, and results enter the caches on the calling thread in file name order, so the
+// outcome is the same for any number of threads. GPU uploads are left to the render thread
+class AssetLoader {
+
+public:
+	static void prefetch(const std::vector<const rapidjson::Value*>& entities, LoadLimit* limit = nullptr);
+
+	static ThreadPool& getPool();
+
+	// Held by a thread loading assets while another may use the caches, as when streaming during a game
+	static std::mutex cacheMutex;
+
+	static void resetTimings();
+	static void addTime(LoadStage stage, double seconds);
+	static void printTimings(double totalSeconds);
+
+private:
+	static ThreadPool* pool;
+
+	// Time spent in each stage summed over all threads
+	static std::mutex timingsMutex;
+	static double stageSeconds[(int)LoadStage::COUNT];
+};
@@ -0,0 +1,238 @@
+#include "Benchmark.h"
+
+#include "chai3d.h"
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <fstream>
+
+#include "Constants.h"
+#include "ForcePipeline.h"
+#include "HapticsController.h"
+#include "LevelBundle.h"
+#include "WorldLoader.h"
+#include "PlayerView.h"
+#include "SceneGraph.h"
+#include "TextureCache.h"
+
+// Size of the offscreen framebuffer
+static const int frameWidth = 1280;
+static const int frameHeight = 720;
+
+// Track the camera follows, from the start line to past the finish (win at x < -0.5)
+static const double trackStart = 0.5;
+static const double trackEnd = -0.55;
+static const double trackStep = 0.002;
+
+// Entity counts of the generated worlds swept by the stress benchmark
+static const int stressCounts[] = { 100, 1000, 10000, 100000 };
+
+// Runs the benchmark for each level. Requires an OpenGL context but no haptic devices or visible display
+void Benchmark::run(const std::vector<std::string>& levels, bool dumpFrames) {
+
+	if (!glfwInit()) {
+		std::cerr << "failed GLFW initialization" << std::endl;
+		exit(-1);
+	}
+
+	for (const std::string& level : levels) {
+		runLevel(level, dumpFrames, trackEnd);
+	}
+	glfwTerminate();
+}
+
+// Generates stress worlds of increasing entity count with the given settings, benchmarks each one and writes the
+// results as CSV for charting against entity count
+void Benchmark::runStress(const StressSettings& settings, const std::string& csvFile) {
+
+	std::vector<std::string> files;
+	for (int count : stressCounts) {
+
+		StressSettings s = settings;
+		s.entityCount = count;
+		std::string file = StressWorld::fileFor(s);
+
+		// Compile the bundle up front so load time measures a normal level load
+		if (!StressWorld::generate(s, file) || !LevelBundle::compile(file)) {
+			return;
+		}
+		files.push_back(file);
+	}
+
+	if (!glfwInit()) {
+		std::cerr << "failed GLFW initialization" << std::endl;
+		exit(-1);
+	}
+
+	std::ofstream csv(csvFile);
+	csv << "entities,load_ms,frame_avg_ms,frame_p95_ms,tick_avg_us,tick_p95_us" << std::endl;
+
+	for (const std::string& file : files) {
+
+		BenchmarkResult r = runLevel(file, false, trackStart - settings.trackLength - 0.05);
+		csv << r.entities << "," << r.loadMs << "," << r.frameAvgMs << "," << r.frameP95Ms << ","
+		    << r.tickAvgUs << "," << r.tickP95Us << std::endl;
+	}
+	glfwTerminate();
+
+	std::cout << std::endl << "Stress results written to " << csvFile << std::endl;
+}
+
+// Loads a level into a fresh scene and renders it frame by frame along the track while moving a cursor through the
+// entities, then prints a summary
+BenchmarkResult Benchmark::runLevel(const std::string& level, bool dumpFrames, double trackEnd) {
+
+	SceneGraph* scene = new SceneGraph();
+	PlayerView* view = new PlayerView(scene, View::P1, frameWidth, frameHeight);
+
+	// Initialize GLEW library once a context exists
+	if (glewInit() != GLEW_OK) {
+		std::cout << "failed to initialize GLEW library" << std::endl;
+		glfwTerminate();
+		exit(-1);
+	}
+
+	chai3d::cPrecisionClock clock;
+	clock.start();
+
+	std::vector<Entity*> entities;
+	WorldLoader::loadWorld(LevelBundle::loadWorld(level), entities);
+	scene->addEntities(entities);
+
+	EntityStore store;
+	for (Entity* e : entities) {
+		store.add(e);
+	}
+	double loadMs = clock.getCurrentTimeSeconds() * 1000.0;
+
+	// Controllers on virtual devices, in a world of their own, run the race force pipeline for the simulated cursor.
+	// The loop state the pipeline changes is kept here, as a controller keeps it for its own loop
+	std::recursive_mutex entityMutex;
+	chai3d::cWorld* hapticWorld = new chai3d::cWorld();
+	HapticsController* self = new HapticsController(chai3d::cGenericHapticDevice::create(), 0, store, entityMutex);
+	HapticsController* partner = new HapticsController(chai3d::cGenericHapticDevice::create(), 1, store, entityMutex);
+	self->setPartner(partner);
+	partner->setPartner(self);
+	self->setupTool(hapticWorld);
+	partner->setupTool(hapticWorld);
+
+	chai3d::cVector3d devicePos(0.0, 0.0, 0.0);
+	chai3d::cVector3d prevWorldPos(0.0, 0.0, 0.0);
+	bool springIntact = true;
+	std::vector<ClosedLoopHaptic*> closedLoopForces;
+	ForceContext tickContext = { *self, *partner, self->getCursor(), store, 0, devicePos, prevWorldPos, springIntact, closedLoopForces };
+
+	std::vector<double> cpuMs;
+	std::vector<double> tickUs;
+	double totalShadowMs = 0.0;
+	int shadowPasses = 0;
+	long long totalDrawCalls = 0;
+	long long totalTriangles = 0;
+	long long totalDrawn = 0;
+	long long totalCulled = 0;
+
+	// Frames are dumped as <level name>_<frame>.png for visual diffing
+	std::string name = level.substr(level.find_last_of("/\\") + 1);
+	name = name.substr(0, name.find_last_of('.'));
+
+	int frame = 0;
+	for (double x = trackStart; x > trackEnd; x -= trackStep, frame++) {
+
+		scene->resetStatistics();
+
+		double startS = clock.getCurrentTimeSeconds();
+		view->render(chai3d::cVector3d(x, 0.0, 0.0));
+		cpuMs.push_back((clock.getCurrentTimeSeconds() - startS) * 1000.0);
+
+		tickUs.push_back(measureTick(tickContext, chai3d::cVector3d(x + trackStep, 0.0, 0.0), chai3d::cVector3d(x, 0.0, 0.0)));
+
+		totalDrawCalls += scene->getDrawCalls();
+		totalTriangles += scene->getTriangles();
+		totalDrawn += scene->getDrawnObjects();
+		totalCulled += scene->getCulledObjects();
+		if (view->getLastShadowPassMs() > 0.0) {
+			totalShadowMs += view->getLastShadowPassMs();
+			shadowPasses++;
+		}
+
+		if (dumpFrames) {
+			view->saveFrame(name + "_" + std::to_string(frame) + ".png");
+		}
+	}
+
+	// Summarize
+	BenchmarkResult result;
+	result.entities = (int)entities.size();
+	result.loadMs = loadMs;
+	result.frameAvgMs = 0.0;
+	for (double t : cpuMs) {
+		result.frameAvgMs += t / frame;
+	}
+	result.frameP95Ms = percentile(cpuMs, 95);
+	result.tickAvgUs = 0.0;
+	for (double t : tickUs) {
+		result.tickAvgUs += t / frame;
+	}
+	result.tickP95Us = percentile(tickUs, 95);
+
+	std::cout << std::endl << "Benchmark: " << level << " (" << entities.size() << " entities, " << frame << " frames)" << std::endl;
+	std::cout << "  load time        " << chai3d::cStr(loadMs, 1) << " ms" << std::endl;
+	std::cout << "  frame CPU time   avg " << chai3d::cStr(result.frameAvgMs, 3) << " ms / "
+	          << "p50 " << chai3d::cStr(percentile(cpuMs, 50), 3) << " ms / "
+	          << "p95 " << chai3d::cStr(result.frameP95Ms, 3) << " ms / "
+	          << "max " << chai3d::cStr(percentile(cpuMs, 100), 3) << " ms" << std::endl;
+	std::cout << "  haptic tick      avg " << chai3d::cStr(result.tickAvgUs, 1) << " us / "
+	          << "p95 " << chai3d::cStr(result.tickP95Us, 1) << " us" << std::endl;
+	std::cout << "  draw calls/frame " << chai3d::cStr((double)totalDrawCalls / frame, 1) << std::endl;
+	std::cout << "  triangles/frame  " << chai3d::cStr((double)totalTriangles / frame, 0) << std::endl;
+	std::cout << "  meshes/frame     drawn " << chai3d::cStr((double)totalDrawn / frame, 1) << " / culled " << chai3d::cStr((double)totalCulled / frame, 1) << std::endl;
+	std::cout << "  shadow passes    " << shadowPasses << ", avg " << chai3d::cStr(shadowPasses > 0 ? totalShadowMs / shadowPasses : 0.0, 3) << " ms" << std::endl;
+	std::cout << "  frame pacing     " << view->getFramePacer()->getSummary() << std::endl;
+	std::cout << "  texture memory   " << chai3d::cStr(TextureCache::getMemoryUsage() / (1024.0 * 1024.0), 2) << " MB" << std::endl;
+
+	// Clean up
+	for (ClosedLoopHaptic* effect : closedLoopForces) {
+		delete effect;
+	}
+	partner->reset();
+	delete self;
+	delete partner;
+	delete hapticWorld;
+
+	for (Entity* e : entities) {
+		scene->removeEntity(e);
+		delete e;
+	}
+	delete view;
+	delete scene;
+
+	return result;
+}
+
+// Returns the time in microseconds taken by one update of the race force pipeline, the same call the haptic loop
+// makes, for a cursor moving between two points with its partner alongside. Device reads and the god object update
+// are left out. Hazards and collectibles the cursor passes are used up and reported as in a race
+double Benchmark::measureTick(ForceContext& c, const chai3d::cVector3d& from, const chai3d::cVector3d& to) {
+
+	c.self.setPosiiton(from);
+	c.prevWorldPos = c.self.getWorldPosition();
+	c.self.setPosiiton(to);
+	c.partner.setPosiiton(to);
+
+	chai3d::cPrecisionClock clock;
+	clock.start(true);
+
+	RacePipeline::apply(c);
+
+	return clock.getCurrentTimeSeconds() * 1000000.0;
+}
+
+// Returns the value below which the given percent of the values fall
+double Benchmark::percentile(std::vector<double> values, int percent) {
+
+	if (values.empty()) {
+		return 0.0;
+	}
+	std::sort(values.begin(), values.end());
+	return values[std::min(values.size() - 1, (values.size() * percent) / 100)];
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "chai3d.h"
+
+#include <string>
+#include <vector>
+
+#include "EntityStore.h"
+#include "StressWorld.h"
+
+struct ForceContext;
+
+// Measurements of one benchmarked level
+struct BenchmarkResult {
+	int entities;
+	double loadMs;
+	double frameAvgMs;
+	double frameP95Ms;
+	double tickAvgUs;
+	double tickP95Us;
+};
+
+// Class that measures loading, rendering and haptic collision performance by flying an offscreen camera and a
+// simulated cursor along each level's track
+class Benchmark {
+
+public:
+	static void run(const std::vector<std::string>& levels, bool dumpFrames);
+	static void runStress(const StressSettings& settings, const std::string& csvFile);
+
+private:
+	static BenchmarkResult runLevel(const std::string& level, bool dumpFrames, double trackEnd);
+	static double measureTick(ForceContext& c, const chai3d::cVector3d& from, const chai3d::cVector3d& to);
+	static double percentile(std::vector<double> values, int percent);
+};
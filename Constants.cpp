@@ -2,10 +2,27 @@
 
 const double Constants::cursorRadius = 0.004;
 
-const double Constants::springK = 300.0;
-const double Constants::springRest = 0.01;
-const double Constants::springMax = 0.08;
+const int Constants::swapInterval = 1;
+const int Constants::maxFramesInFlight = 1;
 
-const double Constants::rateScale = 0.005;
-const double Constants::rateZone = 0.01;
-const double Constants::rateFeedback = 300.0;
\ No newline at end of file
+const double Constants::shadowBudgetMs = 2.0;
+const int Constants::maxShadowQuality = 3;
+const double Constants::shadowMoveThreshold = 0.01;
+const double Constants::shadowCasterThreshold = 0.003;
+
+const bool Constants::trackCulling = true;
+const double Constants::trackCullAhead = 0.6;
+const double Constants::trackCullBehind = 0.1;
+
+const int Constants::lodMinTriangles = 500;
+const double Constants::lodNearDistance = 0.25;
+const double Constants::lodFarDistance = 0.5;
+
+const double Constants::preloadBudgetMB = 512.0;
+
+const double Constants::streamAhead = 0.4;
+const double Constants::streamBehind = 0.15;
+const double Constants::streamBudgetMB = 256.0;
+
+const double Constants::logicRate = 240.0;
+const double Constants::finishLine = -0.5;
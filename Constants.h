@@ -6,11 +6,28 @@ class Constants {
 public:
 	static const double cursorRadius;
 
-	static const double springK;
-	static const double springRest;
-	static const double springMax;
+	static const int swapInterval;
+	static const int maxFramesInFlight;
 
-	static const double rateScale;
-	static const double rateZone;
-	static const double rateFeedback;
+	static const double shadowBudgetMs;
+	static const int maxShadowQuality;
+	static const double shadowMoveThreshold;
+	static const double shadowCasterThreshold;
+
+	static const bool trackCulling;
+	static const double trackCullAhead;
+	static const double trackCullBehind;
+
+	static const int lodMinTriangles;
+	static const double lodNearDistance;
+	static const double lodFarDistance;
+
+	static const double preloadBudgetMB;
+
+	static const double streamAhead;
+	static const double streamBehind;
+	static const double streamBudgetMB;
+
+	static const double logicRate;
+	static const double finishLine;
 };
\ No newline at end of file
@@ -24,15 +24,22 @@ rapidjson::Document ContentReadWrite::readJSON(std::string path) {
 	file.close();
 	buffer[length] = 0;
 
+	rapidjson::Document d = parseJSON(buffer);
+	delete[] buffer;
+
+	return d;
+}
+
+// Parses null terminated JSON text into rapidjson document object
+rapidjson::Document ContentReadWrite::parseJSON(const char* text) {
+
 	// Create JSON document
 	rapidjson::Document d;
-	rapidjson::ParseResult ok = d.Parse<rapidjson::kParseStopWhenDoneFlag>(buffer);
+	rapidjson::ParseResult ok = d.Parse<rapidjson::kParseStopWhenDoneFlag>(text);
 
 	if (!ok) {
 		rapidjson::ParseErrorCode error = ok.Code();
 		std::cout << "error parsing JSON file: " << error << std::endl;
 	}
-	delete[] buffer;
-
 	return d;
 }
\ No newline at end of file
@@ -8,5 +8,6 @@ class ContentReadWrite {
 
 public:
 	static rapidjson::Document readJSON(std::string path);
+	static rapidjson::Document parseJSON(const char* text);
 };
 
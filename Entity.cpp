@@ -1,17 +1,19 @@
 #include "Entity.h"
 
 #include "Constants.h"
+#include "GeometryCache.h"
+#include "TextureCache.h"
 
-// Creates an entity from a file name
-Entity::Entity(std::string filename, View view, chai3d::cTransform transform) : view(view) {
+std::atomic<uint32_t> Entity::nextId(1);
+
+// Creates an entity from a file name. Geometry and collision trees are shared with other entities using the file
+Entity::Entity(std::string filename, View view, chai3d::cTransform transform) : view(view), meshFile(filename), id(nextId++), consumed(false) {
 
 	type = Type::ENTITY;
 
-	mesh = new chai3d::cMultiMesh();
-	mesh->loadFromFile(filename);
+	mesh = GeometryCache::createMesh(filename);
 	mesh->setLocalTransform(transform);
 	mesh->setStiffness(3000.0);
-	mesh->createAABBCollisionDetector(Constants::cursorRadius);
 	mesh->m_material->setUseHapticShading(true);
 
 	mesh->createEffectMagnetic();
@@ -19,26 +21,30 @@ Entity::Entity(std::string filename, View view, chai3d::cTransform transform) :
 
 // Deletes entity and its mesh
 Entity::~Entity() {
-	delete mesh;
+	GeometryCache::releaseMesh(mesh);
 }
 
-// Sets the texure for the mesh
+// Sets the texure for the mesh. The texture is shared with every entity using the same file
 void Entity::setTexture(std::string filename) {
 
+	textureFile = filename;
 	chai3d::cMesh* m = mesh->getMesh(0);
 
-	// Create a colour texture map for this mesh object
-	chai3d::cTexture2dPtr texture = chai3d::cTexture2d::create();
-	texture->loadFromFile(filename);
-	texture->setWrapModeS(GL_REPEAT);
-	texture->setWrapModeT(GL_REPEAT);
-	texture->setUseMipmaps(true);
-
 	// Assign textures to the mesh
-	m->m_texture = texture;
+	m->m_texture = TextureCache::getTexture(filename);
 	m->setUseTexture(true);
 }
 
+// Returns the OBJ file the mesh was loaded from
+std::string Entity::getMeshFile() const {
+	return meshFile;
+}
+
+// Returns the texture file of the mesh, empty if it has none
+std::string Entity::getTextureFile() const {
+	return textureFile;
+}
+
 // Returns the view
 View Entity::getView() const {
 	return view;
@@ -48,3 +54,18 @@ View Entity::getView() const {
 Type Entity::getType() const {
 	return type;
 }
+
+// Returns the id identifying the entity in game events
+uint32_t Entity::getId() const {
+	return id;
+}
+
+// Marks the entity used up, returning true only for the first caller
+bool Entity::consume() {
+	return !consumed.exchange(true);
+}
+
+// Returns if the entity has been used up and is waiting to be removed
+bool Entity::isConsumed() const {
+	return consumed;
+}
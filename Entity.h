@@ -2,7 +2,11 @@
 
 #include "chai3d.h"
 
+#include <atomic>
+#include <cstdint>
+
 enum class View {
+	NONE = 0, // Not rendered directly, e.g. drawn through an instance batch
 	P1 = 1,
 	P2 = 2,
 	BOTH = 3
@@ -26,13 +30,26 @@ public:
 	chai3d::cMultiMesh* mesh;
 
 	void setTexture(std::string filename);
+	std::string getMeshFile() const;
+	std::string getTextureFile() const;
 	View getView() const;
 	Type getType() const;
-	virtual chai3d::cVector3d interact(chai3d::cToolCursor* tool) { return chai3d::cVector3d(0.0, 0.0, 0.0); }
-	virtual bool insideForInteraction() { return true; }
-	virtual bool destoryOnInteract() { return false; }
+	uint32_t getId() const;
+
+	// Claims an entity that is used up by an interaction, returning false if another player already has
+	bool consume();
+	bool isConsumed() const;
 
 protected:
 	View view;
 	Type type;
+
+	std::string meshFile;
+	std::string textureFile;
+
+private:
+	const uint32_t id;
+	std::atomic<bool> consumed;
+
+	static std::atomic<uint32_t> nextId;
 };
\ No newline at end of file
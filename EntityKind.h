@@ -0,0 +1,166 @@
+#pragma once
+
+#include "chai3d.h"
+
+#include <vector>
+
+#include "BombForce.h"
+#include "Collectible.h"
+#include "Entity.h"
+#include "EntityStore.h"
+#include "EventBus.h"
+#include "Hazard.h"
+#include "Magnet.h"
+#include "PickupForce.h"
+#include "Viscous.h"
+
+// State of one player's haptic update, passed to the per-kind interaction kernels
+struct InteractionContext {
+	int player;
+	chai3d::cVector3d velocity;
+	chai3d::cVector3d toolPos;
+
+	// Force on the cursor, and closed loop effects started for the player and the partner
+	chai3d::cVector3d force;
+	std::vector<ClosedLoopHaptic*> effects;
+	std::vector<ClosedLoopHaptic*> partnerEffects;
+};
+
+// Traits of each kind of entity. Contact says if the cursor being inside the entity is tracked, param reads the
+// value kept in the store, and interact applies one entity of the kind to the update. All are resolved at compile
+// time, so the kernels inline into the loop over the kind's arrays
+template<typename T>
+struct EntityKind;
+
+template<>
+struct EntityKind<Entity> {
+	static const Type type = Type::ENTITY;
+	static const bool contact = false;
+
+	static double param(const Entity&) { return 0.0; }
+
+	// Felt through the world by the god object, nothing to do here
+	static void interact(InteractionContext&, const EntityGroup&, size_t) {}
+};
+
+template<>
+struct EntityKind<Viscous> {
+	static const Type type = Type::VISCOUS;
+	static const bool contact = true;
+
+	static double param(const Viscous& v) { return v.getDamping(); }
+
+	// Damps the cursor while it is inside
+	static void interact(InteractionContext& c, const EntityGroup& g, size_t i) {
+		if (g.inside[c.player][i]) {
+			c.force += Viscous::dampingForce(c.velocity, g.params[i]);
+		}
+	}
+};
+
+template<>
+struct EntityKind<Hazard> {
+	static const Type type = Type::HAZARD;
+	static const bool contact = true;
+
+	static double param(const Hazard&) { return 0.0; }
+
+	// Shakes both players and ends the race. Claimed first, so both players cannot use one
+	static void interact(InteractionContext& c, const EntityGroup& g, size_t i) {
+		if (g.inside[c.player][i] && g.entities[i]->consume()) {
+
+			c.effects.push_back(new BombForce(g.positions[i]));
+			c.partnerEffects.push_back(new BombForce(g.positions[i]));
+
+			EventBus::push(EventType::HAZARD_HIT, g.ids[i]);
+			EventBus::push(EventType::ENTITY_DESTROYED, g.ids[i]);
+		}
+	}
+};
+
+template<>
+struct EntityKind<Collectible> {
+	static const Type type = Type::COLLECTIBLE;
+	static const bool contact = true;
+
+	static double param(const Collectible& c) { return c.getTimeBonus(); }
+
+	// Adds its time bonus. Claimed first, so both players cannot use one
+	static void interact(InteractionContext& c, const EntityGroup& g, size_t i) {
+		if (g.inside[c.player][i] && g.entities[i]->consume()) {
+
+			c.effects.push_back(new PickupForce());
+
+			EventBus::push(EventType::COLLECTIBLE_PICKED, g.ids[i], g.params[i]);
+			EventBus::push(EventType::ENTITY_DESTROYED, g.ids[i]);
+		}
+	}
+};
+
+template<>
+struct EntityKind<Magnet> {
+	static const Type type = Type::MAGNET;
+	static const bool contact = false;
+
+	static double param(const Magnet& m) { return m.getStrength(); }
+
+	// Attracts the cursor from any distance
+	static void interact(InteractionContext& c, const EntityGroup& g, size_t i) {
+		c.force += Magnet::attraction(g.entities[i]->mesh, c.toolPos, g.params[i]);
+	}
+};
+
+// Tag naming a kind of entity, for visitors written as generic lambdas
+template<typename T>
+struct KindTag {
+	typedef T type;
+};
+
+// Calls a visitor with the tag of every kind of entity, in a fixed order. This is the one list of kinds, so adding
+// a kind means adding its traits and a line here
+template<typename F>
+inline void forEachKind(F&& f) {
+	f(KindTag<Entity>());
+	f(KindTag<Viscous>());
+	f(KindTag<Hazard>());
+	f(KindTag<Collectible>());
+	f(KindTag<Magnet>());
+}
+
+// Calls a visitor with an entity cast to its own class, chosen by its type. The only place an entity is downcast
+template<typename F>
+inline void visitEntity(Entity* entity, F&& f) {
+
+	switch (entity->getType()) {
+	case Type::VISCOUS:
+		f(static_cast<Viscous*>(entity));
+		break;
+	case Type::HAZARD:
+		f(static_cast<Hazard*>(entity));
+		break;
+	case Type::COLLECTIBLE:
+		f(static_cast<Collectible*>(entity));
+		break;
+	case Type::MAGNET:
+		f(static_cast<Magnet*>(entity));
+		break;
+	default:
+		f(entity);
+		break;
+	}
+}
+
+// Applies every entity of one kind to a player's update
+template<typename T>
+inline void interactWith(EntityStore& store, InteractionContext& c) {
+
+	const EntityGroup& g = store.group<T>();
+	for (size_t i = 0; i < g.size(); i++) {
+		EntityKind<T>::interact(c, g, i);
+	}
+}
+
+// Applies every entity in the store to a player's update, one kind at a time
+inline void interactWithAll(EntityStore& store, InteractionContext& c) {
+	forEachKind([&](auto kind) { interactWith<typename decltype(kind)::type>(store, c); });
+}
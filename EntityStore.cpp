@@ -0,0 +1,158 @@
+#include "EntityStore.h"
+
+#include <algorithm>
+
+#include "Constants.h"
+#include "EntityKind.h"
+
+// Adds an entity to the end of its kind's arrays
+void EntityStore::add(Entity* entity) {
+	visitEntity(entity, [this](auto* e) { addAs(e); });
+}
+
+// Adds an entity of a known kind to the end of the kind's arrays
+template<typename T>
+void EntityStore::addAs(T* entity) {
+
+	EntityGroup& g = group<T>();
+	slotOf[entity] = g.size();
+
+	// Box of the mesh in world space, from its eight transformed corners
+	chai3d::cTransform t = entity->mesh->getLocalTransform();
+	chai3d::cVector3d localMin = entity->mesh->getBoundaryMin();
+	chai3d::cVector3d localMax = entity->mesh->getBoundaryMax();
+	chai3d::cVector3d min = t * localMin;
+	chai3d::cVector3d max = min;
+	for (int i = 1; i < 8; i++) {
+
+		chai3d::cVector3d corner((i & 1) ? localMax.x() : localMin.x(), (i & 2) ? localMax.y() : localMin.y(), (i & 4) ? localMax.z() : localMin.z());
+		chai3d::cVector3d p = t * corner;
+		min.set(std::min(min.x(), p.x()), std::min(min.y(), p.y()), std::min(min.z(), p.z()));
+		max.set(std::max(max.x(), p.x()), std::max(max.y(), p.y()), std::max(max.z(), p.z()));
+	}
+
+	g.entities.push_back(entity);
+	g.ids.push_back(entity->getId());
+	g.boundsMin.push_back(min);
+	g.boundsMax.push_back(max);
+	g.positions.push_back(entity->mesh->getLocalPos());
+	g.params.push_back(EntityKind<T>::param(*entity));
+	g.inside[0].push_back(0);
+	g.inside[1].push_back(0);
+}
+
+// Removes an entity by moving the last entity of its type into its slot
+void EntityStore::remove(const Entity* entity) {
+
+	auto it = slotOf.find(entity);
+	if (it == slotOf.end()) {
+		return;
+	}
+	size_t slot = it->second;
+	slotOf.erase(it);
+
+	EntityGroup& g = group(entity->getType());
+	size_t last = g.size() - 1;
+	if (slot != last) {
+		g.entities[slot] = g.entities[last];
+		g.ids[slot] = g.ids[last];
+		g.boundsMin[slot] = g.boundsMin[last];
+		g.boundsMax[slot] = g.boundsMax[last];
+		g.positions[slot] = g.positions[last];
+		g.params[slot] = g.params[last];
+		g.inside[0][slot] = g.inside[0][last];
+		g.inside[1][slot] = g.inside[1][last];
+		slotOf[g.entities[slot]] = slot;
+	}
+
+	g.entities.pop_back();
+	g.ids.pop_back();
+	g.boundsMin.pop_back();
+	g.boundsMax.pop_back();
+	g.positions.pop_back();
+	g.params.pop_back();
+	g.inside[0].pop_back();
+	g.inside[1].pop_back();
+}
+
+// Removes all entities
+void EntityStore::clear() {
+
+	for (EntityGroup& g : groups) {
+		g = EntityGroup();
+	}
+	slotOf.clear();
+}
+
+// Returns the arrays of one type
+const EntityGroup& EntityStore::group(Type type) const {
+	return groups[(int)type];
+}
+
+// Returns the arrays of one type
+EntityGroup& EntityStore::group(Type type) {
+	return groups[(int)type];
+}
+
+// Returns the number of entities of all types
+size_t EntityStore::size() const {
+	return slotOf.size();
+}
+
+// Updates if a player's cursor is inside each entity it reacts to by being inside, for a cursor moving between two
+// points
+void EntityStore::updateContacts(int player, const chai3d::cVector3d& from, const chai3d::cVector3d& to) {
+
+	forEachKind([&](auto kind) {
+		updateContactsOf<typename decltype(kind)::type>(player, from, to);
+	});
+}
+
+// Updates the contacts of one kind. Only entities whose box is within the cursor radius of the path are tested
+// against their mesh. Kinds without contact are skipped at compile time: plain entities are felt through the world
+// and magnets act at a distance
+template<typename T>
+void EntityStore::updateContactsOf(int player, const chai3d::cVector3d& from, const chai3d::cVector3d& to) {
+
+	if (!EntityKind<T>::contact) {
+		return;
+	}
+
+	double r = Constants::cursorRadius;
+	double minX = std::min(from.x(), to.x()) - r;
+	double minY = std::min(from.y(), to.y()) - r;
+	double minZ = std::min(from.z(), to.z()) - r;
+	double maxX = std::max(from.x(), to.x()) + r;
+	double maxY = std::max(from.y(), to.y()) + r;
+	double maxZ = std::max(from.z(), to.z()) + r;
+
+	chai3d::cCollisionSettings s;
+	s.m_collisionRadius = r;
+
+	EntityGroup& g = group<T>();
+	for (size_t i = 0; i < g.size(); i++) {
+
+		const chai3d::cVector3d& bMin = g.boundsMin[i];
+		const chai3d::cVector3d& bMax = g.boundsMax[i];
+		if (bMin.x() > maxX || bMax.x() < minX || bMin.y() > maxY || bMax.y() < minY || bMin.z() > maxZ || bMax.z() < minZ) {
+			continue;
+		}
+
+		chai3d::cCollisionRecorder rec;
+
+		// Test if cursor entered entity
+		if (g.entities[i]->mesh->computeCollisionDetection(from, to, rec, s)) {
+			g.inside[player][i] = 1;
+		}
+		// Test if cursor exitted entity
+		else if (g.entities[i]->mesh->computeCollisionDetection(to, from, rec, s)) {
+			g.inside[player][i] = 0;
+		}
+	}
+}
+
+template void EntityStore::updateContactsOf<Entity>(int, const chai3d::cVector3d&, const chai3d::cVector3d&);
+template void EntityStore::updateContactsOf<Viscous>(int, const chai3d::cVector3d&, const chai3d::cVector3d&);
+template void EntityStore::updateContactsOf<Hazard>(int, const chai3d::cVector3d&, const chai3d::cVector3d&);
+template void EntityStore::updateContactsOf<Collectible>(int, const chai3d::cVector3d&, const chai3d::cVector3d&);
+template void EntityStore::updateContactsOf<Magnet>(int, const chai3d::cVector3d&, const chai3d::cVector3d&);
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "chai3d.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "Entity.h"
+
+template<typename T>
+struct EntityKind;
+
+// Data the haptic loops use for every entity of one type, in parallel arrays indexed by slot
+struct EntityGroup {
+	std::vector<Entity*> entities;
+	std::vector<uint32_t> ids;
+
+	// World space bounding box of the mesh, for rejecting entities the cursor cannot have touched
+	std::vector<chai3d::cVector3d> boundsMin;
+	std::vector<chai3d::cVector3d> boundsMax;
+	std::vector<chai3d::cVector3d> positions;
+
+	// Damping, time bonus or magnet strength, depending on the type
+	std::vector<double> params;
+
+	// If each player's cursor is inside the entity
+	std::vector<uint8_t> inside[2];
+
+	size_t size() const { return entities.size(); }
+};
+
+// Class that keeps the entities in play grouped by type in contiguous arrays, so the haptic loops walk each type's
+// data linearly instead of calling through entity pointers. The entity classes stay the owners of meshes and
+// textures. Changes are made with the entity lock held, as the haptic loops read the store under it
+class EntityStore {
+
+public:
+	void add(Entity* entity);
+	void remove(const Entity* entity);
+	void clear();
+
+	const EntityGroup& group(Type type) const;
+	EntityGroup& group(Type type);
+	size_t size() const;
+
+	// Returns the arrays of one kind of entity, chosen at compile time. Needs EntityKind.h
+	template<typename T>
+	EntityGroup& group() { return groups[(int)EntityKind<T>::type]; }
+
+	void updateContacts(int player, const chai3d::cVector3d& from, const chai3d::cVector3d& to);
+
+	template<typename T>
+	void updateContactsOf(int player, const chai3d::cVector3d& from, const chai3d::cVector3d& to);
+
+	static const int numTypes = 5;
+
+private:
+	EntityGroup groups[numTypes];
+
+	// Group and slot of each entity, for removal
+	std::unordered_map<const Entity*, size_t> slotOf;
+
+	template<typename T>
+	void addAs(T* entity);
+};
@@ -0,0 +1,217 @@
+#include "EventBus.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// Event log header, followed by raw GameEvent records
+static const char logMagic[4] = { 'H', 'E', 'V', 'T' };
+static const uint32_t logVersion = 1;
+
+// Returns a clock started when the program starts, used for event timestamps
+static chai3d::cPrecisionClock startedClock() {
+	chai3d::cPrecisionClock clock;
+	clock.start(true);
+	return clock;
+}
+
+chai3d::cPrecisionClock EventBus::clock = startedClock();
+std::mutex EventBus::ringsMutex;
+std::vector<EventRing*> EventBus::rings;
+std::atomic<unsigned int> EventBus::dropped(0);
+
+Signal<const GameEvent&> EventBus::subscribers[(int)EventType::COUNT];
+std::ofstream* EventBus::log = nullptr;
+std::vector<GameEvent> EventBus::pending;
+
+// Adds an event to the ring, returning false if the ring is full
+bool EventRing::push(const GameEvent& event) {
+
+	unsigned int t = tail.load(std::memory_order_relaxed);
+	if (t - head.load(std::memory_order_acquire) == capacity) {
+		return false;
+	}
+	events[t % capacity] = event;
+	tail.store(t + 1, std::memory_order_release);
+	return true;
+}
+
+// Takes the oldest event from the ring, returning false if the ring is empty
+bool EventRing::pop(GameEvent& event) {
+
+	unsigned int h = head.load(std::memory_order_relaxed);
+	if (h == tail.load(std::memory_order_acquire)) {
+		return false;
+	}
+	event = events[h % capacity];
+	head.store(h + 1, std::memory_order_release);
+	return true;
+}
+
+// Returns if every event pushed has been taken
+bool EventRing::empty() const {
+	return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+}
+
+// Pushes an event from the calling thread, timestamped now. Events are dropped if the thread's ring is full,
+// which only happens if the game logic thread stops dispatching
+void EventBus::push(EventType type, uint32_t entity, double value) {
+
+	GameEvent event;
+	event.tick = now();
+	event.type = type;
+	memset(event.reserved, 0, sizeof(event.reserved));
+	event.entity = entity;
+	event.value = value;
+
+	if (!ringForThread()->push(event)) {
+		dropped++;
+	}
+}
+
+// Delivers the events pushed so far by all threads in timestamp order, logging them first if a log is open
+void EventBus::dispatch() {
+
+	{
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		GameEvent event;
+		for (EventRing* ring : rings) {
+			while (ring->pop(event)) {
+				pending.push_back(event);
+			}
+		}
+	}
+
+	unsigned int lost = dropped.exchange(0);
+	if (lost > 0) {
+		std::cout << "Event bus dropped " << lost << " events" << std::endl;
+	}
+	if (pending.empty()) {
+		return;
+	}
+
+	// Each ring is in order already, so a stable sort keeps a thread's events with the same tick in push order
+	std::stable_sort(pending.begin(), pending.end(), [](const GameEvent& a, const GameEvent& b) {
+		return a.tick < b.tick;
+	});
+
+	if (log != nullptr) {
+		log->write((const char*)pending.data(), pending.size() * sizeof(GameEvent));
+		log->flush();
+	}
+
+	for (const GameEvent& event : pending) {
+		subscribers[(int)event.type].emit(event);
+	}
+	pending.clear();
+}
+
+// Returns the signal for a type of event
+Signal<const GameEvent&>& EventBus::on(EventType type) {
+	return subscribers[(int)type];
+}
+
+// Starts appending dispatched events to a new log file
+bool EventBus::openLog(const std::string& filename) {
+
+	closeLog();
+	log = new std::ofstream(filename, std::ios::binary);
+	if (!log->is_open()) {
+		std::cout << "Could not open event log " << filename << std::endl;
+		closeLog();
+		return false;
+	}
+
+	uint32_t recordSize = sizeof(GameEvent);
+	log->write(logMagic, sizeof(logMagic));
+	log->write((const char*)&logVersion, sizeof(logVersion));
+	log->write((const char*)&recordSize, sizeof(recordSize));
+	return true;
+}
+
+// Stops logging events
+void EventBus::closeLog() {
+	delete log;
+	log = nullptr;
+}
+
+// Reads all events from a log file written by openLog
+bool EventBus::readLog(const std::string& filename, std::vector<GameEvent>& events) {
+
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "Could not open event log " << filename << std::endl;
+		return false;
+	}
+
+	char magic[4];
+	uint32_t version = 0;
+	uint32_t recordSize = 0;
+	file.read(magic, sizeof(magic));
+	file.read((char*)&version, sizeof(version));
+	file.read((char*)&recordSize, sizeof(recordSize));
+	if (!file || memcmp(magic, logMagic, sizeof(magic)) != 0 || version != logVersion || recordSize != sizeof(GameEvent)) {
+		std::cout << "Not a supported event log " << filename << std::endl;
+		return false;
+	}
+
+	GameEvent event;
+	while (file.read((char*)&event, sizeof(event))) {
+		events.push_back(event);
+	}
+	return true;
+}
+
+// Returns a readable name for a type of event
+const char* EventBus::typeName(EventType type) {
+
+	switch (type) {
+	case EventType::HAZARD_HIT:
+		return "hazard hit";
+	case EventType::COLLECTIBLE_PICKED:
+		return "collectible picked";
+	case EventType::SPRING_BROKEN:
+		return "spring broken";
+	case EventType::ENTITY_DESTROYED:
+		return "entity destroyed";
+	default:
+		return "unknown";
+	}
+}
+
+// Returns the calling thread's ring, registering one on its first event. Rings are reused after their thread
+// exits and they are drained, since haptic threads are started again for each game
+EventRing* EventBus::ringForThread() {
+
+	// Marks the ring released when the thread exits
+	struct Owner {
+		EventRing* ring = nullptr;
+		~Owner() {
+			if (ring != nullptr) {
+				ring->released = true;
+			}
+		}
+	};
+	static thread_local Owner owner;
+
+	if (owner.ring == nullptr) {
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		for (EventRing* ring : rings) {
+			if (ring->released && ring->empty()) {
+				ring->released = false;
+				owner.ring = ring;
+				break;
+			}
+		}
+		if (owner.ring == nullptr) {
+			owner.ring = new EventRing();
+			rings.push_back(owner.ring);
+		}
+	}
+	return owner.ring;
+}
+
+// Returns the microseconds since the program started
+uint64_t EventBus::now() {
+	return (uint64_t)(clock.getCurrentTimeSeconds() * 1000000.0);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "chai3d.h"
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Signal.h"
+
+enum class EventType : uint8_t {
+	HAZARD_HIT,
+	COLLECTIBLE_PICKED,
+	SPRING_BROKEN,
+	ENTITY_DESTROYED,
+	COUNT
+};
+
+// Game event. Plain data, so it is copied into rings and written to the event log as is
+struct GameEvent {
+	uint64_t tick;    // Microseconds since the bus started
+	EventType type;
+	uint8_t reserved[3];
+	uint32_t entity;  // Id of the entity involved, 0 for none
+	double value;     // Time bonus of a pickup
+};
+static_assert(std::is_trivially_copyable<GameEvent>::value && sizeof(GameEvent) == 24, "GameEvent is logged as raw bytes");
+
+// Ring of events from one producer thread to the dispatcher. Only the producer moves the tail and only the
+// dispatcher moves the head, so neither side locks
+class EventRing {
+
+public:
+	EventRing() : released(false), head(0), tail(0) {}
+
+	bool push(const GameEvent& event);
+	bool pop(GameEvent& event);
+	bool empty() const;
+
+	// Set when the producer thread exits, so the ring can be given to a new thread once drained
+	std::atomic<bool> released;
+
+private:
+	static const unsigned int capacity = 1024;
+	GameEvent events[capacity];
+
+	// The dispatcher writes the head and the producer the tail, so they are kept a cache line apart
+	std::atomic<unsigned int> head;
+	char headPadding[64 - sizeof(std::atomic<unsigned int>)];
+	std::atomic<unsigned int> tail;
+};
+
+// Class that carries game events from any thread to subscribers. Each producing thread pushes into its own ring, and
+// dispatch() delivers everything pushed so far in timestamp order on the thread that calls it, the game logic
+// thread while a race runs. Events can also be appended to a binary log for analytics
+class EventBus {
+
+public:
+	static void push(EventType type, uint32_t entity = 0, double value = 0.0);
+	static void dispatch();
+
+	// Signal emitted by dispatch() for each event of a type, on the game logic thread. Subscribers that must run on
+	// the main thread connect through a queued connection, as Program does for ENTITY_DESTROYED
+	static Signal<const GameEvent&>& on(EventType type);
+
+	static bool openLog(const std::string& filename);
+	static void closeLog();
+	static bool readLog(const std::string& filename, std::vector<GameEvent>& events);
+	static const char* typeName(EventType type);
+
+private:
+	static chai3d::cPrecisionClock clock;
+	static std::mutex ringsMutex;
+	static std::vector<EventRing*> rings;
+	static std::atomic<unsigned int> dropped;
+
+	static Signal<const GameEvent&> subscribers[(int)EventType::COUNT];
+	static std::ofstream* log;
+
+	// Events taken from the rings by the last dispatch, kept to reuse its storage
+	static std::vector<GameEvent> pending;
+
+	static EventRing* ringForThread();
+	static uint64_t now();
+};
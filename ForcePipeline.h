@@ -0,0 +1,159 @@
+#pragma once
+
+#include "chai3d.h"
+
+#include <vector>
+
+#include "ClosedLoopHaptic.h"
+#include "EntityKind.h"
+#include "EntityStore.h"
+#include "EventBus.h"
+#include "ForceTuning.h"
+#include "HapticsController.h"
+
+// State of one player's haptic loop that the force stages read and change. Built by the controller when its loop
+// starts, and only used on the haptics thread with the entity lock held
+struct ForceContext {
+	HapticsController& self;
+	HapticsController& partner;
+	chai3d::cToolCursor* tool;
+	EntityStore& store;
+	int player;
+
+	const chai3d::cVector3d& devicePos;
+	chai3d::cVector3d& prevWorldPos;
+	bool& springIntact;
+	std::vector<ClosedLoopHaptic*>& closedLoopForces;
+};
+
+// Force pipeline made of a list of stage types, each with a static apply(ForceContext&). The stages run in list
+// order every haptic update, with no branching or calls through pointers between them, so a pipeline without a
+// stage pays nothing for it
+template<typename... Stages>
+struct ForcePipeline {
+
+	static void apply(ForceContext& c) {
+		int order[] = { 0, (Stages::apply(c), 0)... };
+		(void)order;
+	}
+};
+
+// Moves the tool and camera when the device leaves the rate zone, with a force pushing it back
+template<typename T>
+struct RateControlStage {
+
+	static void apply(ForceContext& c) {
+
+		chai3d::cVector3d disp(0.0, 0.0, 0.0);
+		chai3d::cVector3d xPos(c.devicePos.x(), 0.0, 0.0);
+
+		if (c.devicePos.x() > T::rateZone) {
+
+			disp = xPos - chai3d::cVector3d(T::rateZone, 0.0, 0.0);
+			c.tool->setLocalPos(T::rateScale * disp + c.tool->getLocalPos());
+
+			// Velocity setting not great
+			c.tool->setDeviceLocalLinVel((T::rateScale * disp) / 0.001 + c.tool->getDeviceLocalLinVel());
+		}
+		else if (c.devicePos.x() < -T::rateZone) {
+
+			disp = xPos - chai3d::cVector3d(-T::rateZone, 0.0, 0.0);
+			c.tool->setLocalPos(T::rateScale * disp + c.tool->getLocalPos());
+
+			// Velocity setting not great
+			c.tool->setDeviceLocalLinVel((T::rateScale * disp) / 0.001 + c.tool->getDeviceLocalLinVel());
+		}
+		c.tool->addDeviceLocalForce(-T::rateFeedback * disp);
+	}
+};
+
+// Pulls the players together while the spring between them is stretched, and breaks it when stretched too far
+template<typename T>
+struct SpringStage {
+
+	static void apply(ForceContext& c) {
+
+		chai3d::cVector3d force(0.0, 0.0, 0.0);
+		chai3d::cVector3d dir = c.partner.getWorldPosition() - c.self.getWorldPosition();
+		double dist = dir.length();
+		dir.normalize();
+
+		// Test to see if spring has broken
+		if (c.springIntact && dist > T::springMax) {
+			EventBus::push(EventType::SPRING_BROKEN);
+			c.springIntact = false;
+		}
+
+		// Calculate spring force only if spring is elongated
+		if (c.springIntact && dist >= T::springRest) {
+			force = dir * (dist - T::springRest) * T::springK;
+		}
+		c.tool->addDeviceLocalForce(force);
+	}
+};
+
+// Applies the listed kinds of entity to the cursor. Kinds left out of the list are neither contact tested nor
+// visited
+template<typename... Kinds>
+struct EntityStage {
+
+	static void apply(ForceContext& c) {
+
+		chai3d::cVector3d newPos = c.self.getWorldPosition();
+		int contacts[] = { 0, (c.store.updateContactsOf<Kinds>(c.player, c.prevWorldPos, newPos), 0)... };
+		(void)contacts;
+
+		InteractionContext ic;
+		ic.player = c.player;
+		ic.velocity = c.tool->getDeviceLocalLinVel();
+		ic.toolPos = c.tool->getLocalTransform() * c.tool->m_hapticPoint->m_sphereProxy->getLocalPos();
+		ic.force.zero();
+		int kinds[] = { 0, (interactWith<Kinds>(c.store, ic), 0)... };
+		(void)kinds;
+
+		for (ClosedLoopHaptic* effect : ic.effects) {
+			c.closedLoopForces.push_back(effect);
+		}
+		for (ClosedLoopHaptic* effect : ic.partnerEffects) {
+			c.partner.addClosedLoopForce(effect);
+		}
+		c.prevWorldPos = c.self.getWorldPosition();
+
+		c.tool->addDeviceLocalForce(ic.force);
+	}
+};
+
+// Adds the forces of running closed loop effects, deleting those that are done
+struct ClosedLoopStage {
+
+	static void apply(ForceContext& c) {
+
+		for (auto it = c.closedLoopForces.begin(); it != c.closedLoopForces.end();) {
+
+			if ((*it)->done()) {
+				delete (*it);
+				it = c.closedLoopForces.erase(it);
+			}
+			else {
+				c.tool->addDeviceLocalForce((*it)->getForce(c.tool));
+				++it;
+			}
+		}
+	}
+};
+
+// Pipeline of a race
+typedef ForcePipeline<
+	RateControlStage<Tuning>,
+	SpringStage<Tuning>,
+	EntityStage<Viscous, Hazard, Collectible, Magnet>,
+	ClosedLoopStage
+> RacePipeline;
+
+// Pipeline of training mode, where hazards do nothing
+typedef ForcePipeline<
+	RateControlStage<Tuning>,
+	SpringStage<Tuning>,
+	EntityStage<Viscous, Collectible, Magnet>,
+	ClosedLoopStage
+> TrainingPipeline;
@@ -0,0 +1,56 @@
+#include "ForceTuning.h"
+
+constexpr double FixedTuning::springK;
+constexpr double FixedTuning::springRest;
+constexpr double FixedTuning::springMax;
+
+constexpr double FixedTuning::rateScale;
+constexpr double FixedTuning::rateZone;
+constexpr double FixedTuning::rateFeedback;
+
+#ifdef TUNING_BUILD
+
+#include <iostream>
+
+#include "ContentReadWrite.h"
+
+double RuntimeTuning::springK = FixedTuning::springK;
+double RuntimeTuning::springRest = FixedTuning::springRest;
+double RuntimeTuning::springMax = FixedTuning::springMax;
+
+double RuntimeTuning::rateScale = FixedTuning::rateScale;
+double RuntimeTuning::rateZone = FixedTuning::rateZone;
+double RuntimeTuning::rateFeedback = FixedTuning::rateFeedback;
+
+// Reads tunables from a JSON object, e.g. { "springK": 250.0 }. Values not in the file are left unchanged
+bool RuntimeTuning::load(const std::string& filename) {
+
+	rapidjson::Document d = ContentReadWrite::readJSON(filename);
+	if (!d.IsObject()) {
+		std::cout << "Could not read tuning file " << filename << std::endl;
+		return false;
+	}
+
+	struct Value {
+		const char* name;
+		double* value;
+	};
+	Value values[] = {
+		{ "springK", &springK },
+		{ "springRest", &springRest },
+		{ "springMax", &springMax },
+		{ "rateScale", &rateScale },
+		{ "rateZone", &rateZone },
+		{ "rateFeedback", &rateFeedback }
+	};
+
+	for (const Value& v : values) {
+		if (d.HasMember(v.name) && d[v.name].IsNumber()) {
+			*v.value = d[v.name].GetDouble();
+			std::cout << "Tuning " << v.name << " = " << *v.value << std::endl;
+		}
+	}
+	return true;
+}
+
+#endif
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+
+// Spring and rate control tunables as compile time constants, so the force stages fold them into their arithmetic
+struct FixedTuning {
+	static constexpr double springK = 300.0;
+	static constexpr double springRest = 0.01;
+	static constexpr double springMax = 0.08;
+
+	static constexpr double rateScale = 0.005;
+	static constexpr double rateZone = 0.01;
+	static constexpr double rateFeedback = 300.0;
+};
+
+#ifdef TUNING_BUILD
+
+// Spring and rate control tunables that can be changed at run time, for tuning builds. Start at the fixed values
+// and are read from a JSON file of the same names. Change only while the haptic loops are stopped
+struct RuntimeTuning {
+	static double springK;
+	static double springRest;
+	static double springMax;
+
+	static double rateScale;
+	static double rateZone;
+	static double rateFeedback;
+
+	static bool load(const std::string& filename);
+};
+
+typedef RuntimeTuning Tuning;
+
+#else
+
+typedef FixedTuning Tuning;
+
+#endif
@@ -0,0 +1,166 @@
+#include "FramePacer.h"
+
+#include <algorithm>
+
+// Number of frames kept for frame-time statistics
+static const int statisticsWindow = 240;
+
+// Creates a frame pacer. Must be created with the view's OpenGL context current
+FramePacer::FramePacer(int maxFramesInFlight) : maxFramesInFlight(maxFramesInFlight), frameTimes(statisticsWindow, 0.0) {
+
+	// Fences need GL 3.2 or ARB_sync, otherwise fall back to stalling with glFinish
+	useFences = (GLEW_ARB_sync != 0);
+	if (!useFences) {
+		std::cout << "Warning: ARB_sync not supported, falling back to glFinish for frame pacing" << std::endl;
+	}
+
+	resetStatistics();
+	clock.start();
+}
+
+// Deletes any outstanding fences. Must be destroyed with the view's OpenGL context current
+FramePacer::~FramePacer() {
+
+	for (GLsync fence : fences) {
+		glDeleteSync(fence);
+	}
+	fences.clear();
+}
+
+// Blocks until fewer than the maximum number of frames are still being processed by the GPU
+void FramePacer::beginFrame() {
+
+	if (!useFences) {
+		return;
+	}
+
+	while ((int)fences.size() >= maxFramesInFlight && !fences.empty()) {
+		waitForFence(fences.front());
+		glDeleteSync(fences.front());
+		fences.pop_front();
+	}
+}
+
+// Marks the end of the submitted frame with a fence and records the frame time
+void FramePacer::endFrame() {
+
+	if (useFences && maxFramesInFlight > 0) {
+		fences.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+	}
+	else {
+		double startS = clock.getCurrentTimeSeconds();
+		glFinish();
+		gpuWaitS += clock.getCurrentTimeSeconds() - startS;
+	}
+
+	// Record time since the end of the previous frame
+	double nowS = clock.getCurrentTimeSeconds();
+	if (lastFrameEndS >= 0.0) {
+		frameTimes[nextFrame] = (nowS - lastFrameEndS) * 1000.0;
+		nextFrame = (nextFrame + 1) % statisticsWindow;
+		numFrames = std::min(numFrames + 1, statisticsWindow);
+	}
+	lastFrameEndS = nowS;
+}
+
+// Waits on a fence, flushing so the fence is guaranteed to signal
+void FramePacer::waitForFence(GLsync fence) {
+
+	double startS = clock.getCurrentTimeSeconds();
+
+	GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	while (result == GL_TIMEOUT_EXPIRED) {
+		result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1 ms
+	}
+	gpuWaitS += clock.getCurrentTimeSeconds() - startS;
+}
+
+// Sets the maximum number of frames that may be queued on the GPU. Zero restores glFinish behaviour
+void FramePacer::setMaxFramesInFlight(int maxFramesInFlight) {
+	this->maxFramesInFlight = std::max(maxFramesInFlight, 0);
+}
+
+// Returns the maximum number of frames that may be queued on the GPU
+int FramePacer::getMaxFramesInFlight() const {
+	return maxFramesInFlight;
+}
+
+// Returns the duration of the most recent frame in milliseconds
+double FramePacer::getLastFrameMs() const {
+
+	if (numFrames == 0) {
+		return 0.0;
+	}
+	return frameTimes[(nextFrame + statisticsWindow - 1) % statisticsWindow];
+}
+
+// Returns the average frame time over the statistics window in milliseconds
+double FramePacer::getAverageFrameMs() const {
+
+	if (numFrames == 0) {
+		return 0.0;
+	}
+
+	double sum = 0.0;
+	for (int i = 0; i < numFrames; i++) {
+		sum += frameTimes[i];
+	}
+	return sum / numFrames;
+}
+
+// Returns the shortest frame time over the statistics window in milliseconds
+double FramePacer::getMinFrameMs() const {
+
+	if (numFrames == 0) {
+		return 0.0;
+	}
+	return *std::min_element(frameTimes.begin(), frameTimes.begin() + numFrames);
+}
+
+// Returns the longest frame time over the statistics window in milliseconds
+double FramePacer::getMaxFrameMs() const {
+
+	if (numFrames == 0) {
+		return 0.0;
+	}
+	return *std::max_element(frameTimes.begin(), frameTimes.begin() + numFrames);
+}
+
+// Returns the standard deviation of frame times over the statistics window in milliseconds
+double FramePacer::getJitterMs() const {
+
+	if (numFrames < 2) {
+		return 0.0;
+	}
+
+	double avg = getAverageFrameMs();
+	double sum = 0.0;
+	for (int i = 0; i < numFrames; i++) {
+		sum += (frameTimes[i] - avg) * (frameTimes[i] - avg);
+	}
+	return sqrt(sum / (numFrames - 1));
+}
+
+// Returns the total time spent waiting on the GPU since statistics were reset in milliseconds
+double FramePacer::getGpuWaitMs() const {
+	return gpuWaitS * 1000.0;
+}
+
+// Clears all recorded statistics
+void FramePacer::resetStatistics() {
+
+	lastFrameEndS = -1.0;
+	gpuWaitS = 0.0;
+	nextFrame = 0;
+	numFrames = 0;
+}
+
+// Returns a one line summary of the frame-time statistics
+std::string FramePacer::getSummary() const {
+
+	return "avg " + chai3d::cStr(getAverageFrameMs(), 2) + " ms / " +
+	       "min " + chai3d::cStr(getMinFrameMs(), 2) + " ms / " +
+	       "max " + chai3d::cStr(getMaxFrameMs(), 2) + " ms / " +
+	       "jitter " + chai3d::cStr(getJitterMs(), 2) + " ms / " +
+	       "GPU wait " + chai3d::cStr(getGpuWaitMs(), 1) + " ms";
+}
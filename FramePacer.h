@@ -0,0 +1,46 @@
+#pragma once
+
+#include "chai3d.h"
+
+#include <deque>
+#include <vector>
+
+// Class that limits the number of frames queued on the GPU for one view and records frame-time statistics
+class FramePacer {
+
+public:
+	FramePacer(int maxFramesInFlight);
+	virtual ~FramePacer();
+
+	void beginFrame();
+	void endFrame();
+
+	void setMaxFramesInFlight(int maxFramesInFlight);
+	int getMaxFramesInFlight() const;
+
+	double getLastFrameMs() const;
+	double getAverageFrameMs() const;
+	double getMinFrameMs() const;
+	double getMaxFrameMs() const;
+	double getJitterMs() const;
+	double getGpuWaitMs() const;
+	void resetStatistics();
+
+	std::string getSummary() const;
+
+private:
+	int maxFramesInFlight;
+	bool useFences;
+	std::deque<GLsync> fences;
+
+	chai3d::cPrecisionClock clock;
+	double lastFrameEndS;
+	double gpuWaitS;
+
+	// Ring buffer of recent frame times in milliseconds
+	std::vector<double> frameTimes;
+	int nextFrame;
+	int numFrames;
+
+	void waitForFence(GLsync fence);
+};
@@ -0,0 +1,133 @@
+#include "GameLogic.h"
+
+#include <chrono>
+
+#include "Constants.h"
+
+// Bit of the middle buffer index set when it holds a snapshot the reader has not taken
+static const int freshSnapshot = 4;
+
+// Creates the logic for a race between two players and starts its thread. No race runs until startRace
+GameLogic::GameLogic(HapticsController* p1, HapticsController* p2) : p1(p1), p2(p2), running(true), state(State::DEFAULT), timeLimit(0.0), acceptEvents(false), step(0), snapshots(), back(0), front(1), middle(2) {
+
+	EventType types[] = { EventType::HAZARD_HIT, EventType::COLLECTIBLE_PICKED, EventType::SPRING_BROKEN };
+	for (EventType type : types) {
+		connections.push_back({ type, EventBus::on(type).connect_member(this, &GameLogic::handleEvent) });
+	}
+
+	publish();
+	thread = std::thread(&GameLogic::run, this);
+}
+
+// Stops the logic thread
+GameLogic::~GameLogic() {
+
+	running = false;
+	if (thread.joinable()) {
+		thread.join();
+	}
+	for (const std::pair<EventType, int>& c : connections) {
+		EventBus::on(c.first).disconnect(c.second);
+	}
+}
+
+// Starts a race with the given time limit. Events still queued from an earlier race are discarded
+void GameLogic::startRace(double timeLimit) {
+
+	std::lock_guard<std::mutex> lock(mutex);
+	acceptEvents = false;
+	EventBus::dispatch();
+	acceptEvents = true;
+
+	this->timeLimit = timeLimit;
+	clock.start(true);
+	state = State::RUNNING;
+	publish();
+}
+
+// Moves a won or lost race to the end screen, once the renderers have shown the result
+void GameLogic::endRace() {
+
+	std::lock_guard<std::mutex> lock(mutex);
+	state = State::END;
+	publish();
+}
+
+// Changes the time limit of the race, as when the world file is reloaded
+void GameLogic::setTimeLimit(double timeLimit) {
+
+	std::lock_guard<std::mutex> lock(mutex);
+	this->timeLimit = timeLimit;
+}
+
+// Returns the last published state. Called from the main thread only
+GameSnapshot GameLogic::getSnapshot() const {
+
+	if (middle.load(std::memory_order_relaxed) & freshSnapshot) {
+		front = middle.exchange(front, std::memory_order_acq_rel) & ~freshSnapshot;
+	}
+	return snapshots[front];
+}
+
+// Steps the logic at a fixed rate until stopped. Late steps are not made up, so a stall does not cause a burst
+void GameLogic::run() {
+
+	std::chrono::steady_clock::duration period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / Constants::logicRate));
+	std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+
+	while (running) {
+
+		update();
+
+		next += period;
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (next < now) {
+			next = now;
+		}
+		std::this_thread::sleep_until(next);
+	}
+}
+
+// Applies the game events pushed since the last step, then checks the race clock and the finish line
+void GameLogic::update() {
+
+	std::lock_guard<std::mutex> lock(mutex);
+	EventBus::dispatch();
+
+	if (state == State::RUNNING) {
+
+		if (clock.getCurrentTimeSeconds() >= timeLimit) {
+			state = State::LOSE;
+		}
+		else if (p1->getWorldPosition().x() < Constants::finishLine && p2->getWorldPosition().x() < Constants::finishLine) {
+			state = State::WIN;
+		}
+	}
+	step++;
+	publish();
+}
+
+// Publishes a new snapshot of the race. Called with the lock held
+void GameLogic::publish() {
+
+	GameSnapshot& s = snapshots[back];
+	s.state = state;
+	s.timeLeft = (state == State::DEFAULT) ? 0.0 : timeLimit - clock.getCurrentTimeSeconds();
+	s.step = step;
+	back = middle.exchange(back | freshSnapshot, std::memory_order_acq_rel) & ~freshSnapshot;
+}
+
+// Applies a game event to the race. Called by the event bus dispatch with the lock held
+void GameLogic::handleEvent(const GameEvent& event) {
+
+	if (!acceptEvents || state != State::RUNNING) {
+		return;
+	}
+
+	if (event.type == EventType::HAZARD_HIT || event.type == EventType::SPRING_BROKEN) {
+		state = State::LOSE;
+	}
+	else if (event.type == EventType::COLLECTIBLE_PICKED) {
+		clock.reset(clock.getCurrentTimeSeconds() - event.value);
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "chai3d.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "EventBus.h"
+#include "HapticsController.h"
+
+enum class State {
+	RUNNING,
+	WIN,
+	LOSE,
+	END,
+	DEFAULT
+};
+
+// Game state published by the logic thread
+struct GameSnapshot {
+	State state;
+	double timeLeft;
+	uint64_t step;
+};
+
+// Class that runs the race rules at a fixed rate on its own thread, independent of the frame rate. Each step takes
+// the game events pushed by the haptic loops, advances the countdown, checks for a win or loss and publishes a
+// snapshot for the renderers. The logic thread is the event bus dispatcher while it runs
+class GameLogic {
+
+public:
+	GameLogic(HapticsController* p1, HapticsController* p2);
+	~GameLogic();
+
+	void startRace(double timeLimit);
+	void endRace();
+	void setTimeLimit(double timeLimit);
+
+	GameSnapshot getSnapshot() const;
+
+private:
+	HapticsController* p1;
+	HapticsController* p2;
+
+	std::thread thread;
+	std::atomic<bool> running;
+
+	// Race state, used by the logic thread and changed by the main thread under the lock
+	std::mutex mutex;
+	State state;
+	double timeLimit;
+	chai3d::cPrecisionClock clock;
+	bool acceptEvents;
+	uint64_t step;
+
+	// Snapshots in a triple buffer, so publishing neither allocates nor waits for the reader. The writer fills the
+	// back buffer and swaps it with the middle one, marked fresh. The reader takes the middle buffer as its front
+	// one when it is fresh. Only one thread may read
+	GameSnapshot snapshots[3];
+	int back;
+	mutable int front;
+	mutable std::atomic<int> middle;
+
+	// Event bus connections, removed when the logic is deleted
+	std::vector<std::pair<EventType, int>> connections;
+
+	void run();
+	void update();
+	void publish();
+
+	void handleEvent(const GameEvent& event);
+};
@@ -0,0 +1,170 @@
+#include "GeometryCache.h"
+
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+
+#include "Constants.h"
+#include "MeshFile.h"
+
+std::map<unsigned long long, chai3d::cMultiMesh*> GeometryCache::prototypes;
+std::map<std::string, GeometryCache::KnownHash> GeometryCache::knownHashes;
+
+// Returns a new mesh with its own material and transform that shares geometry and collision data with the cached
+// prototype for the file, loading the prototype first if needed
+chai3d::cMultiMesh* GeometryCache::createMesh(const std::string& filename) {
+
+	unsigned long long hash;
+	if (!findHash(filename, hash)) {
+		if (!hashFile(filename, hash)) {
+			std::cout << "Could not open mesh file " << filename << std::endl;
+			return new chai3d::cMultiMesh();
+		}
+		rememberHash(filename, hash);
+	}
+
+	chai3d::cMultiMesh*& prototype = prototypes[hash];
+	if (prototype == nullptr) {
+		prototype = loadPrototype(filename);
+		buildCollisionTree(prototype);
+	}
+
+	// Materials are duplicated as entities change stiffness and haptic settings, vertex data is shared
+	chai3d::cMultiMesh* mesh = prototype->copy(true, false, false, false);
+	for (int i = 0; i < mesh->getNumMeshes(); i++) {
+		mesh->getMesh(i)->setCollisionDetector(prototype->getMesh(i)->getCollisionDetector());
+	}
+	return mesh;
+}
+
+// Returns if a prototype for the file is cached and the file has not changed since it was hashed
+bool GeometryCache::hasPrototype(const std::string& filename) {
+
+	unsigned long long hash;
+	if (!findHash(filename, hash)) {
+		return false;
+	}
+	auto it = prototypes.find(hash);
+	return it != prototypes.end() && it->second != nullptr;
+}
+
+// Adds a prototype loaded elsewhere, such as from a level bundle, for a file whose contents hash is known. The mesh
+// must already have its collision tree. The cache takes ownership of the mesh
+void GeometryCache::addPrototype(const std::string& filename, unsigned long long hash, chai3d::cMultiMesh* mesh) {
+
+	rememberHash(filename, hash);
+
+	chai3d::cMultiMesh*& prototype = prototypes[hash];
+	if (prototype != nullptr) {
+		delete mesh;
+		return;
+	}
+	prototype = mesh;
+}
+
+// Returns an estimate of the memory held by the prototypes
+size_t GeometryCache::getMemoryUsage() {
+
+	size_t total = 0;
+	for (const std::pair<const unsigned long long, chai3d::cMultiMesh*>& p : prototypes) {
+		total += estimateBytes(p.second);
+	}
+	return total;
+}
+
+// Returns an estimate of the memory held by a mesh. Each vertex stores several vectors and a colour, each triangle
+// its indices and about two collision tree nodes
+size_t GeometryCache::estimateBytes(chai3d::cMultiMesh* mesh) {
+	return 160 * (size_t)mesh->getNumVertices() + 140 * (size_t)mesh->getNumTriangles();
+}
+
+// Builds the collision tree shared by all copies of a prototype
+void GeometryCache::buildCollisionTree(chai3d::cMultiMesh* mesh) {
+	mesh->createAABBCollisionDetector(Constants::cursorRadius);
+}
+
+// Loads the compiled version of an OBJ when it is up to date, otherwise parses the OBJ and compiles it for next time
+chai3d::cMultiMesh* GeometryCache::loadPrototype(const std::string& filename) {
+
+	std::string compiled = MeshFile::compiledFile(filename);
+	if (MeshFile::isUpToDate(compiled, filename)) {
+		chai3d::cMultiMesh* mesh = MeshFile::load(compiled);
+		if (mesh != nullptr) {
+			return mesh;
+		}
+	}
+
+	chai3d::cMultiMesh* mesh = new chai3d::cMultiMesh();
+	if (mesh->loadFromFile(filename)) {
+		MeshFile::save(compiled, mesh);
+	}
+	return mesh;
+}
+
+// Deletes a mesh created by the cache, leaving the shared collision trees to the prototype
+void GeometryCache::releaseMesh(chai3d::cMultiMesh* mesh) {
+
+	for (int i = 0; i < mesh->getNumMeshes(); i++) {
+		mesh->getMesh(i)->setCollisionDetector(nullptr);
+	}
+	delete mesh;
+}
+
+// Computes a 64 bit FNV-1a hash of a file's contents
+bool GeometryCache::hashFile(const std::string& filename, unsigned long long& hash) {
+
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	hash = 14695981039346656037ULL;
+	char buffer[4096];
+	while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
+		for (std::streamsize i = 0; i < file.gcount(); i++) {
+			hash ^= (unsigned char)buffer[i];
+			hash *= 1099511628211ULL;
+		}
+	}
+	return true;
+}
+
+// Finds the known hash of a file, if the file still has the modification time and size it had when hashed
+bool GeometryCache::findHash(const std::string& filename, unsigned long long& hash) {
+
+	auto known = knownHashes.find(filename);
+	if (known == knownHashes.end()) {
+		return false;
+	}
+
+	// A file that was missing when hashed, as for bundled assets shipped without sources, stays valid while missing
+	int64_t modified = -1;
+	int64_t size = -1;
+	fileInfo(filename, modified, size);
+	if (modified != known->second.modified || size != known->second.size) {
+		knownHashes.erase(known);
+		return false;
+	}
+	hash = known->second.hash;
+	return true;
+}
+
+// Records the hash of a file along with its current modification time and size
+void GeometryCache::rememberHash(const std::string& filename, unsigned long long hash) {
+
+	KnownHash known = { hash, -1, -1 };
+	fileInfo(filename, known.modified, known.size);
+	knownHashes[filename] = known;
+}
+
+// Gets the modification time and size of a file. Returns false if the file does not exist
+bool GeometryCache::fileInfo(const std::string& filename, int64_t& modified, int64_t& size) {
+
+	struct stat info;
+	if (stat(filename.c_str(), &info) != 0) {
+		return false;
+	}
+	modified = (int64_t)info.st_mtime;
+	size = (int64_t)info.st_size;
+	return true;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "chai3d.h"
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+// Class that parses each distinct OBJ file and builds its collision tree once. Entities receive copies sharing the
+// vertex, triangle and collision data of a prototype. Prototypes are kept for the lifetime of the program so
+// reloading a level does not load any geometry again
+class GeometryCache {
+
+public:
+	static chai3d::cMultiMesh* createMesh(const std::string& filename);
+	static void releaseMesh(chai3d::cMultiMesh* mesh);
+
+	static bool hasPrototype(const std::string& filename);
+	static void addPrototype(const std::string& filename, unsigned long long hash, chai3d::cMultiMesh* mesh);
+
+	static size_t getMemoryUsage();
+	static size_t estimateBytes(chai3d::cMultiMesh* mesh);
+
+	// Loading steps that are safe to run on other threads, for loaders that fill the cache in parallel
+	static chai3d::cMultiMesh* loadPrototype(const std::string& filename);
+	static void buildCollisionTree(chai3d::cMultiMesh* mesh);
+	static bool hashFile(const std::string& filename, unsigned long long& hash);
+
+private:
+	// Prototypes keyed by a hash of the file contents, so copies of an asset under another name are shared too
+	static std::map<unsigned long long, chai3d::cMultiMesh*> prototypes;
+
+	// Contents hash of a file along with the modification time and size it had when hashed
+	struct KnownHash {
+		unsigned long long hash;
+		int64_t modified;
+		int64_t size;
+	};
+
+	// Hashes already known for each file, from a level bundle or an earlier load, so a file is only read again
+	// once it changes
+	static std::map<std::string, KnownHash> knownHashes;
+
+	static bool findHash(const std::string& filename, unsigned long long& hash);
+	static void rememberHash(const std::string& filename, unsigned long long hash);
+	static bool fileInfo(const std::string& filename, int64_t& modified, int64_t& size);
+};
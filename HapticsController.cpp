@@ -1,26 +1,36 @@
 #include "HapticsController.h"
 
 #include "Constants.h"
+#include "EventBus.h"
+#include "StartupTrace.h"
 
-#include "PickupForce.h"
-#include "BombForce.h"
+#include "ForcePipeline.h"
 
 // Creates a controller for the provided haptic device
-HapticsController::HapticsController(chai3d::cGenericHapticDevicePtr device, const std::vector<Entity*>& entities) : device(device), entities(entities) {
+HapticsController::HapticsController(chai3d::cGenericHapticDevicePtr device, int player, EntityStore& store, std::recursive_mutex& entityMutex) : device(device), player(player), store(store), entityMutex(entityMutex) {
 
 	springIntact = true;
+	training = false;
 
 	running = false;
-	finished = false;
+	finished = true;
 
-	device->open();
-	device->calibrate();
+	{
+		TracePhase phase("open device");
+		device->open();
+	}
+	{
+		TracePhase phase("calibrate device");
+		device->calibrate();
+	}
 
 	prevWorldPos.zero();
 }
 
-// Closes device controller
+// Stops the haptics thread and closes device controller
 HapticsController::~HapticsController() {
+	stop();
+	join();
 	device->close();
 }
 
@@ -29,6 +39,12 @@ void HapticsController::setPartner(HapticsController* partner) {
 	this->partner = partner;
 }
 
+// Sets if the controller runs the training force pipeline, where hazards do nothing. Takes effect when the loop
+// next starts
+void HapticsController::setTraining(bool training) {
+	this->training = training;
+}
+
 // Adds provided force to the list of closed loop forces
 void HapticsController::addClosedLoopForce(ClosedLoopHaptic* force) {
 	closedLoopForces.push_back(force);
@@ -46,8 +62,9 @@ void HapticsController::setupTool(chai3d::cWorld* w) {
 	tool->start();
 	world->addChild(tool);
 
-	// Create a renderable copy of the tool (for other player's view)
+	// Create a renderable copy of the tool (for other player's view). It shares the world with the tools so must not be felt
 	avatarCopy = new chai3d::cShapeSphere(Constants::cursorRadius);
+	avatarCopy->setHapticEnabled(false);
 	//avatarCopy->m_material->setTransparencyLevel(0.7);
 	//avatarCopy->setUseTransparency(true);
 	avatarCopy->m_material->setOrange();
@@ -62,22 +79,46 @@ void HapticsController::setPosiiton(chai3d::cVector3d pos) {
 	tool->m_hapticPoint->initialize(pos);
 }
 
-// Resets all state for a new game
+// Resets all state for a new game. Called while the haptics loop is stopped
 void HapticsController::reset() {
 	
 	springIntact = true;
 
-	for (std::pair<const Entity*, bool> p : insideEntity) {
-
-		insideEntity[p.first] = false;
+	for (ClosedLoopHaptic* force : closedLoopForces) {
+		delete force;
 	}
+	closedLoopForces.clear();
 }
 
-// Starts the haptics loop
+// Starts the haptics loop on its own thread. Does nothing if the loop is already running
 void HapticsController::start() {
 
+	{
+		std::lock_guard<std::mutex> lock(lifecycleMutex);
+		if (!finished) {
+			return;
+		}
+		finished = false;
+	}
 	running = true;
 
+	// The pipeline is chosen once here, so the loop itself has no mode checks
+	void(*entry)(void*) = training ? &runLoop<TrainingPipeline> : &runLoop<RacePipeline>;
+	thread.start(entry, chai3d::CTHREAD_PRIORITY_HAPTICS, this);
+}
+
+// Entry point of the haptics thread
+template<typename Pipeline>
+void HapticsController::runLoop(void* controller) {
+	((HapticsController*)controller)->loop<Pipeline>();
+}
+
+// Runs the haptics loop with the given force pipeline until stopped
+template<typename Pipeline>
+void HapticsController::loop() {
+
+	ForceContext c = { *this, *partner, tool, store, player, devicePos, prevWorldPos, springIntact, closedLoopForces };
+
 	bool button0Hold = false;
 	while (running) {
 
@@ -92,29 +133,17 @@ void HapticsController::start() {
 
 		// Update positions
 		device->getPosition(devicePos);
+
+		// Perform interactions and calculate forces. Closed loop effects are also added to by the partner's
+		// loop, so they are used under the lock too
+		std::unique_lock<std::recursive_mutex> lock(entityMutex);
 		world->computeGlobalPositions();
 		tool->updateFromDevice();
 		avatarCopy->setLocalPos(prevWorldPos);
 
-		// Perform interactions and calculate forces
 		tool->computeInteractionForces();
-		performRateControl();
-		applySpringForce();
-		performEntityInteraction();
-
-		// Closed loop haptics forces
-		for (auto it = closedLoopForces.begin(); it != closedLoopForces.end(); ++it) {
-
-			if ((*it)->done()) {
-				auto del = it;
-				--it;
-				delete (*del);
-				closedLoopForces.erase(del);
-			}
-			else {
-				tool->addDeviceLocalForce((*it)->getForce(tool));
-			}
-		}
+		Pipeline::apply(c);
+		lock.unlock();
 
 		// Apply forces to tool and signal frequency counter
 		tool->applyToDevice();
@@ -122,113 +151,28 @@ void HapticsController::start() {
 	}
 
 	// Exit haptics thread
+	std::lock_guard<std::mutex> lock(lifecycleMutex);
 	finished = true;
+	loopFinished.notify_all();
 }
 
-// Performs interaction between cursor and entities in the world
-void HapticsController::performEntityInteraction() {
-
-	chai3d::cVector3d force(0.0, 0.0, 0.0);
-	chai3d::cVector3d newPos = getWorldPosition();
-
-
-	for (Entity* e : entities) {
-
-		if (insideEntity.count(e) == 0) {
-			insideEntity[e] = false;
-		}
-
-		chai3d::cCollisionRecorder r;
-		chai3d::cCollisionSettings s;
-		s.m_collisionRadius = Constants::cursorRadius;
-
-		// Test if cursor entered entity
-		if (e->mesh->computeCollisionDetection(prevWorldPos, newPos, r, s)) {
-			insideEntity[e] = true;
-		}
-		// Test if cursor exitted entity
-		else if (e->mesh->computeCollisionDetection(newPos, prevWorldPos, r, s)) {
-			insideEntity[e] = false;
-		}
-
-		if (!e->insideForInteraction() || insideEntity[e]) {
-			force += e->interact(tool);
-
-			if (e->getType() == Type::HAZARD) {
-				closedLoopForces.push_back(new BombForce(e->mesh->getLocalPos()));
-				partner->addClosedLoopForce(new BombForce(e->mesh->getLocalPos()));
-			}
-			else if (e->getType() == Type::COLLECTIBLE) {
-				closedLoopForces.push_back(new PickupForce());
-			}
-
-			if (e->destoryOnInteract()) {
-				insideEntity.erase(e);
-				destroyEntity.emit(e);
-			}
-		}
-	}
-	prevWorldPos = getWorldPosition();
-
-	tool->addDeviceLocalForce(force);
-}
-
-// Computes and applies spring force to toolf
-void HapticsController::applySpringForce() {
-
-	chai3d::cVector3d force(0.0, 0.0, 0.0);
-	chai3d::cVector3d pos = getWorldPosition();
-	chai3d::cVector3d partnerPos = partner->getWorldPosition();
-	chai3d::cVector3d dir = partnerPos - getWorldPosition();
-	double dist = dir.length();
-	dir.normalize();
-
-	// Test to see if spring has broken
-	if (dist > Constants::springMax) {
-		springBroken.emit();
-		springIntact = false;
-	}
-
-	// Calculate spring force only if spring is elongated
-	if (springIntact && dist >= Constants::springRest) {
-		force = dir * (dist - Constants::springRest) * Constants::springK;
-	}
-	tool->addDeviceLocalForce(force);
+// Tells the haptics thread to stop running. The loop exits at the end of its current update
+void HapticsController::stop() {
+	running = false;
 }
 
-// Updates tool and camera position based on rate control rules
-void HapticsController::performRateControl() {
-
-	chai3d::cVector3d disp(0.0, 0.0, 0.0);
-	chai3d::cVector3d xPos(devicePos.x(), 0.0, 0.0);
-
-	if (devicePos.x() > Constants::rateZone) {
-
-		disp = xPos - chai3d::cVector3d(Constants::rateZone, 0.0, 0.0);
-		tool->setLocalPos(Constants::rateScale * disp + tool->getLocalPos());
-
-		// Velocity setting not great
-		tool->setDeviceLocalLinVel((Constants::rateScale * disp) / 0.001 + tool->getDeviceLocalLinVel());
-	}
-	else if (devicePos.x() < -Constants::rateZone) {
-
-		disp = xPos - chai3d::cVector3d(-Constants::rateZone, 0.0, 0.0);
-		tool->setLocalPos(Constants::rateScale * disp + tool->getLocalPos());
+// Waits until the haptics loop has exited, returning at once if it is not running
+void HapticsController::join() {
 
-		// Velocity setting not great
-		tool->setDeviceLocalLinVel((Constants::rateScale * disp) / 0.001 + tool->getDeviceLocalLinVel());
-	}
-	tool->addDeviceLocalForce(-Constants::rateFeedback * disp);
+	std::unique_lock<std::mutex> lock(lifecycleMutex);
+	loopFinished.wait(lock, [this] { return finished; });
 }
 
-// Tells the haptics thread to stop running
-void HapticsController::stop() {
-	running = false;
-}
+// Returns if the haptics loop is running
+bool HapticsController::isRunning() const {
 
-// Returns if haptics thread has finished running
-bool HapticsController::isFinished() const {
-	return finished;
+	std::lock_guard<std::mutex> lock(lifecycleMutex);
+	return !finished;
 }
 
 // Returns the position of the proxy in world coordinates
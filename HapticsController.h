@@ -2,25 +2,30 @@
 
 #include "chai3d.h"
 
-#include <map>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <vector>
 
 #include "Entity.h"
-#include "Signal.h"
+#include "EntityStore.h"
 #include "ClosedLoopHaptic.h"
 
 // Class that handles the haptic device of one player
 class HapticsController {
 
 public:
-	HapticsController(chai3d::cGenericHapticDevicePtr device, const std::vector<Entity*>& entities);
+	HapticsController(chai3d::cGenericHapticDevicePtr device, int player, EntityStore& store, std::recursive_mutex& entityMutex);
 	virtual ~HapticsController();
 
 	void setPartner(HapticsController* partner);
+	void setTraining(bool training);
 
+	// Haptics thread lifecycle, called from the main thread
 	void start();
 	void stop();
-	bool isFinished() const;
+	void join();
+	bool isRunning() const;
 
 	chai3d::cVector3d getWorldPosition() const;
 	double getFrequency() const;
@@ -33,24 +38,32 @@ public:
 	void setPosiiton(chai3d::cVector3d pos);
 	void reset();
 
-	Signal<Entity*> destroyEntity;
-	Signal<> springBroken;
-
 private:
 	chai3d::cGenericHapticDevicePtr device;
 	chai3d::cWorld* world;
 	HapticsController* partner;
 	chai3d::cToolCursor* tool;
 
-	const std::vector<Entity*>& entities;
-	std::map<const Entity*, bool> insideEntity;
+	// Index of the player, for the player's contact state in the store
+	int player;
+
+	// Entities and the scene may change while the game runs. The lock is held while they are used each update
+	EntityStore& store;
+	std::recursive_mutex& entityMutex;
 
 	std::vector<ClosedLoopHaptic*> closedLoopForces;
 
 	bool springIntact;
 
-	bool running;
+	// Runs the training force pipeline instead of the race one. Read when the loop starts
+	bool training;
+
+	// Cleared to ask the loop to exit. Finished is set by the loop on exit, under the lifecycle lock
+	chai3d::cThread thread;
+	std::atomic<bool> running;
 	bool finished;
+	mutable std::mutex lifecycleMutex;
+	std::condition_variable loopFinished;
 
 	mutable chai3d::cFrequencyCounter hapticFreq;
 
@@ -60,7 +73,9 @@ private:
 	// Allows other player to see avatar
 	chai3d::cShapeSphere* avatarCopy;
 
-	void performEntityInteraction();
-	void applySpringForce();
-	void performRateControl();
+	template<typename Pipeline>
+	static void runLoop(void* controller);
+
+	template<typename Pipeline>
+	void loop();
 };
\ No newline at end of file
@@ -22,10 +22,6 @@ void InputHandler::keyCallback(GLFWwindow* window, int key, int scancode, int ac
 		return;
 	}
 
-	else if (p->getState() == State::LOSE || p->getState() == State::WIN) {
-		p->restartGame();
-	}
-
 	if (key == GLFW_KEY_ESCAPE || key == GLFW_KEY_Q) {
 		glfwSetWindowShouldClose(window, GLFW_TRUE);
 	}
@@ -0,0 +1,394 @@
+#include "InstanceBatch.h"
+
+#include "PlayerView.h"
+#include "SceneGraph.h"
+
+std::map<int, InstanceBatch::GpuProgram> InstanceBatch::programs;
+
+// Vertex shader reproducing the fixed function lighting chai3d sets up, with the model transform per instance
+static const char* vertexShader =
+	"#version 120\n"
+	"attribute mat4 instanceTransform;\n"
+	"uniform bool lightOn[8];\n"
+	"varying vec4 colour;\n"
+	"varying vec2 texCoord;\n"
+	"void main() {\n"
+	"	vec4 eyePos = gl_ModelViewMatrix * (instanceTransform * gl_Vertex);\n"
+	"	vec3 n = normalize(gl_NormalMatrix * (mat3(instanceTransform) * gl_Normal));\n"
+	"	colour = gl_FrontLightModelProduct.sceneColor;\n"
+	"	for (int i = 0; i < 8; i++) {\n"
+	"		if (!lightOn[i]) continue;\n"
+	"		vec3 l = (gl_LightSource[i].position.w == 0.0) ? normalize(gl_LightSource[i].position.xyz) : normalize(gl_LightSource[i].position.xyz - eyePos.xyz);\n"
+	"		float spot = 1.0;\n"
+	"		if (gl_LightSource[i].spotCutoff <= 90.0) {\n"
+	"			spot = (dot(-l, normalize(gl_LightSource[i].spotDirection)) >= gl_LightSource[i].spotCosCutoff) ? 1.0 : 0.0;\n"
+	"		}\n"
+	"		colour += gl_FrontLightProduct[i].ambient + spot * max(dot(n, l), 0.0) * gl_FrontLightProduct[i].diffuse;\n"
+	"	}\n"
+	"	colour.a = gl_FrontMaterial.diffuse.a;\n"
+	"	texCoord = gl_MultiTexCoord0.xy;\n"
+	"	gl_Position = gl_ProjectionMatrix * eyePos;\n"
+	"}\n";
+
+static const char* fragmentShader =
+	"#version 120\n"
+	"uniform sampler2D colourMap;\n"
+	"uniform bool useTexture;\n"
+	"varying vec4 colour;\n"
+	"varying vec2 texCoord;\n"
+	"void main() {\n"
+	"	gl_FragColor = useTexture ? colour * texture2D(colourMap, texCoord) : colour;\n"
+	"}\n";
+
+// Creates a batch drawing the geometry and material of the provided mesh, with optional reduced detail levels
+InstanceBatch::InstanceBatch(chai3d::cMultiMesh* source, const std::vector<chai3d::cMultiMesh*>& reducedLevels) {
+
+	prototype = source->copy(false, false, false, false);
+	prototype->setLocalTransform(chai3d::cTransform());
+
+	levels.push_back(prototype);
+	levels.insert(levels.end(), reducedLevels.begin(), reducedLevels.end());
+
+	visible.resize(levels.size());
+	transforms.resize(levels.size());
+}
+
+// Releases the prototype and the batch's GPU buffers. Reduced levels belong to the level of detail cache. Buffers of
+// a share group whose windows are all destroyed went with it
+InstanceBatch::~InstanceBatch() {
+
+	GLFWwindow* current = glfwGetCurrentContext();
+	for (std::pair<const int, GpuBuffers>& b : buffers) {
+
+		GLFWwindow* window = PlayerView::getGroupWindow(b.first);
+		if (window == nullptr) {
+			continue;
+		}
+		if (PlayerView::getShareGroup(glfwGetCurrentContext()) != b.first) {
+			glfwMakeContextCurrent(window);
+		}
+		deleteBuffers(b.second);
+	}
+	if (glfwGetCurrentContext() != current) {
+		glfwMakeContextCurrent(current);
+	}
+
+	delete prototype;
+}
+
+// Returns if a mesh can be drawn through a batch. Transparent and multi part meshes are drawn normally
+bool InstanceBatch::canBatch(const chai3d::cMultiMesh* mesh) {
+	return mesh->getNumMeshes() == 1 && !mesh->getUseTransparency();
+}
+
+// Adds an object whose transform places a new instance
+void InstanceBatch::addInstance(const chai3d::cGenericObject* instance) {
+
+	instanceIndex[instance] = (int)instances.size();
+	instances.push_back(instance);
+}
+
+// Removes an instance in constant time by moving the last instance into its slot
+void InstanceBatch::removeInstance(const chai3d::cGenericObject* instance) {
+
+	auto it = instanceIndex.find(instance);
+	if (it == instanceIndex.end()) {
+		return;
+	}
+
+	int index = it->second;
+	instances[index] = instances.back();
+	instanceIndex[instances[index]] = index;
+	instances.pop_back();
+	instanceIndex.erase(it);
+}
+
+// Returns the number of instances in the batch
+int InstanceBatch::getNumInstances() const {
+	return (int)instances.size();
+}
+
+// Culls each instance against the scene's active view, picks its level of detail and draws the survivors
+void InstanceBatch::renderInstances(chai3d::cRenderOptions& a_options, SceneGraph& scene) {
+
+	// Batched meshes are opaque, so skip transparent passes
+	if (a_options.m_render_transparent_back_faces_only || a_options.m_render_transparent_front_faces_only) {
+		return;
+	}
+
+	chai3d::cVector3d min = prototype->getBoundaryMin();
+	chai3d::cVector3d max = prototype->getBoundaryMax();
+	chai3d::cVector3d localCenter = (min + max) * 0.5;
+	double radius = 0.5 * (max - min).length();
+	bool testFrustum = !a_options.m_creating_shadow_map;
+
+	for (size_t i = 0; i < levels.size(); i++) {
+		visible[i].clear();
+		transforms[i].clear();
+	}
+
+	for (const chai3d::cGenericObject* instance : instances) {
+
+		chai3d::cTransform t = instance->getLocalTransform();
+		chai3d::cVector3d center = t * localCenter;
+		if (!scene.isInsideView(center, radius, testFrustum)) {
+			scene.countCulled(1);
+			continue;
+		}
+
+		int level = scene.selectLevel(center, radius, (int)levels.size());
+		visible[level].push_back(instance);
+
+		const double* data = t.getData();
+		for (int i = 0; i < 16; i++) {
+			transforms[level].push_back((float)data[i]);
+		}
+	}
+
+	int group = PlayerView::getShareGroup(glfwGetCurrentContext());
+	bool instanced = instancingSupported() && group >= 0 && getProgram(group).valid;
+	for (size_t level = 0; level < levels.size(); level++) {
+
+		int count = (int)visible[level].size();
+		if (count == 0) {
+			continue;
+		}
+
+		int tris = count * levels[level]->getNumTriangles();
+		if (instanced) {
+			drawInstanced(a_options, getProgram(group), getBuffers(group), (int)level);
+			scene.countDrawn(count, 1, tris);
+		}
+		else {
+			drawSeparately(a_options, (int)level);
+			scene.countDrawn(count, count, tris);
+		}
+	}
+}
+
+// Issues a single instanced draw for the visible instances of one level
+void InstanceBatch::drawInstanced(chai3d::cRenderOptions& a_options, const GpuProgram& program, GpuBuffers& gpu, int level) {
+
+	const GpuGeometry& g = gpu.levels[level];
+	chai3d::cMesh* m = prototype->getMesh(0);
+
+	// Material and texture set the fixed function state read by the shader
+	m->m_material->render(a_options);
+	bool useTexture = (m->m_texture != nullptr) && m->getUseTexture();
+	if (useTexture) {
+		m->m_texture->renderInitialize(a_options);
+	}
+
+	glUseProgram(program.program);
+	GLint lightOn[8];
+	for (int i = 0; i < 8; i++) {
+		lightOn[i] = glIsEnabled(GL_LIGHT0 + i);
+	}
+	glUniform1iv(program.lightOnUniform, 8, lightOn);
+	glUniform1i(program.useTextureUniform, useTexture ? 1 : 0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, g.positions);
+	glVertexPointer(3, GL_FLOAT, 0, 0);
+	glEnableClientState(GL_VERTEX_ARRAY);
+
+	glBindBuffer(GL_ARRAY_BUFFER, g.normals);
+	glNormalPointer(GL_FLOAT, 0, 0);
+	glEnableClientState(GL_NORMAL_ARRAY);
+
+	glBindBuffer(GL_ARRAY_BUFFER, g.texCoords);
+	glTexCoordPointer(2, GL_FLOAT, 0, 0);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+	// Per instance transforms, one matrix column per attribute
+	const std::vector<float>& t = transforms[level];
+	glBindBuffer(GL_ARRAY_BUFFER, gpu.instanceTransforms);
+	glBufferData(GL_ARRAY_BUFFER, t.size() * sizeof(float), t.data(), GL_STREAM_DRAW);
+	for (int i = 0; i < 4; i++) {
+		glEnableVertexAttribArray(program.transformAttrib + i);
+		glVertexAttribPointer(program.transformAttrib + i, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (void*)(4 * i * sizeof(float)));
+		glVertexAttribDivisorARB(program.transformAttrib + i, 1);
+	}
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g.indices);
+	glDrawElementsInstancedARB(GL_TRIANGLES, g.numIndices, GL_UNSIGNED_INT, 0, (GLsizei)visible[level].size());
+
+	// Restore state for chai3d
+	for (int i = 0; i < 4; i++) {
+		glVertexAttribDivisorARB(program.transformAttrib + i, 0);
+		glDisableVertexAttribArray(program.transformAttrib + i);
+	}
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glUseProgram(0);
+
+	if (useTexture) {
+		m->m_texture->renderFinalize(a_options);
+	}
+}
+
+// Fallback without instancing support: draws the level once per visible instance
+void InstanceBatch::drawSeparately(chai3d::cRenderOptions& a_options, int level) {
+
+	chai3d::cMultiMesh* mesh = levels[level];
+	if (level > 0) {
+		chai3d::cMesh* m = mesh->getMesh(0);
+		m->m_material = prototype->getMesh(0)->m_material;
+		m->m_texture = prototype->getMesh(0)->m_texture;
+		m->setUseTexture(prototype->getMesh(0)->getUseTexture());
+	}
+
+	for (const chai3d::cGenericObject* instance : visible[level]) {
+		glPushMatrix();
+		glMultMatrixd(instance->getLocalTransform().getData());
+		mesh->renderSceneGraph(a_options);
+		glPopMatrix();
+	}
+}
+
+// Returns the batch's buffers in a share group, uploading the geometry of every level on first use
+InstanceBatch::GpuBuffers& InstanceBatch::getBuffers(int group) {
+
+	auto it = buffers.find(group);
+	if (it != buffers.end()) {
+		return it->second;
+	}
+
+	GpuBuffers gpu;
+	for (chai3d::cMultiMesh* level : levels) {
+		gpu.levels.push_back(upload(level->getMesh(0)));
+	}
+	glGenBuffers(1, &gpu.instanceTransforms);
+
+	return buffers[group] = gpu;
+}
+
+// Returns the instancing shader of a share group, compiling it on first use
+const InstanceBatch::GpuProgram& InstanceBatch::getProgram(int group) {
+
+	auto it = programs.find(group);
+	if (it != programs.end()) {
+		return it->second;
+	}
+
+	GpuProgram p;
+	p.program = compileProgram();
+	p.transformAttrib = glGetAttribLocation(p.program, "instanceTransform");
+	p.lightOnUniform = glGetUniformLocation(p.program, "lightOn");
+	p.useTextureUniform = glGetUniformLocation(p.program, "useTexture");
+	p.valid = (p.program != 0) && (p.transformAttrib >= 0);
+
+	return programs[group] = p;
+}
+
+// Deletes the shader of a share group whose last window is about to be destroyed, with that window current
+void InstanceBatch::releaseShareGroup(int group) {
+
+	auto it = programs.find(group);
+	if (it == programs.end()) {
+		return;
+	}
+	if (it->second.program != 0) {
+		glDeleteProgram(it->second.program);
+	}
+	programs.erase(it);
+}
+
+// Deletes buffers created by getBuffers. A context of their share group must be current
+void InstanceBatch::deleteBuffers(GpuBuffers& gpu) {
+
+	for (GpuGeometry& g : gpu.levels) {
+		GLuint ids[] = { g.positions, g.normals, g.texCoords, g.indices };
+		glDeleteBuffers(4, ids);
+	}
+	glDeleteBuffers(1, &gpu.instanceTransforms);
+	gpu.levels.clear();
+}
+
+// Uploads the vertices and triangles of a mesh to buffers in the current context
+InstanceBatch::GpuGeometry InstanceBatch::upload(chai3d::cMesh* mesh) {
+
+	chai3d::cVertexArrayPtr verts = mesh->m_vertices;
+	chai3d::cTriangleArrayPtr tris = mesh->m_triangles;
+
+	std::vector<float> positions;
+	std::vector<float> normals;
+	std::vector<float> texCoords;
+	for (unsigned int i = 0; i < verts->getNumElements(); i++) {
+
+		chai3d::cVector3d p = verts->getLocalPos(i);
+		chai3d::cVector3d n = verts->getNormal(i);
+		chai3d::cVector3d t = verts->getTexCoord(i);
+
+		positions.insert(positions.end(), { (float)p.x(), (float)p.y(), (float)p.z() });
+		normals.insert(normals.end(), { (float)n.x(), (float)n.y(), (float)n.z() });
+		texCoords.insert(texCoords.end(), { (float)t.x(), (float)t.y() });
+	}
+
+	std::vector<GLuint> indices;
+	for (unsigned int i = 0; i < tris->getNumElements(); i++) {
+		indices.insert(indices.end(), { tris->getVertexIndex0(i), tris->getVertexIndex1(i), tris->getVertexIndex2(i) });
+	}
+
+	GpuGeometry g;
+	g.numIndices = (int)indices.size();
+
+	glGenBuffers(1, &g.positions);
+	glBindBuffer(GL_ARRAY_BUFFER, g.positions);
+	glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(float), positions.data(), GL_STATIC_DRAW);
+
+	glGenBuffers(1, &g.normals);
+	glBindBuffer(GL_ARRAY_BUFFER, g.normals);
+	glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(float), normals.data(), GL_STATIC_DRAW);
+
+	glGenBuffers(1, &g.texCoords);
+	glBindBuffer(GL_ARRAY_BUFFER, g.texCoords);
+	glBufferData(GL_ARRAY_BUFFER, texCoords.size() * sizeof(float), texCoords.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glGenBuffers(1, &g.indices);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g.indices);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	return g;
+}
+
+// Returns if the current context supports shader based instanced drawing
+bool InstanceBatch::instancingSupported() {
+	return GLEW_VERSION_2_0 && GLEW_ARB_instanced_arrays && GLEW_ARB_draw_instanced;
+}
+
+// Compiles and links the instancing shader program in the current context
+GLuint InstanceBatch::compileProgram() {
+
+	GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(vs, 1, &vertexShader, NULL);
+	glCompileShader(vs);
+
+	GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(fs, 1, &fragmentShader, NULL);
+	glCompileShader(fs);
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vs);
+	glAttachShader(program, fs);
+	glLinkProgram(program);
+
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+
+	// Batches fall back to separate draws if the shader cannot be used
+	GLint linked;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked) {
+		char log[1024];
+		glGetProgramInfoLog(program, sizeof(log), NULL, log);
+		std::cerr << "failed to link instancing shader: " << log << std::endl;
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
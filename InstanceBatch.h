@@ -0,0 +1,76 @@
+#pragma once
+
+#include "chai3d.h"
+#include <GLFW/glfw3.h>
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+class SceneGraph;
+
+// Class that draws every entity sharing a mesh and material with one instanced draw call per level of detail
+class InstanceBatch : public chai3d::cGenericObject {
+
+public:
+	InstanceBatch(chai3d::cMultiMesh* source, const std::vector<chai3d::cMultiMesh*>& reducedLevels);
+	virtual ~InstanceBatch();
+
+	void addInstance(const chai3d::cGenericObject* instance);
+	void removeInstance(const chai3d::cGenericObject* instance);
+	int getNumInstances() const;
+
+	void renderInstances(chai3d::cRenderOptions& a_options, SceneGraph& scene);
+
+	static bool canBatch(const chai3d::cMultiMesh* mesh);
+	static void releaseShareGroup(int group);
+
+private:
+	// Full detail prototype shares vertex, material and texture data with the entity meshes. Reduced levels
+	// are shared with other batches and borrow the prototype's material and texture when drawn
+	chai3d::cMultiMesh* prototype;
+	std::vector<chai3d::cMultiMesh*> levels;
+
+	// Objects whose local transforms place each instance
+	std::vector<const chai3d::cGenericObject*> instances;
+	std::unordered_map<const chai3d::cGenericObject*, int> instanceIndex;
+
+	// Instances that survive culling and their transforms per level, rebuilt each draw
+	std::vector<std::vector<const chai3d::cGenericObject*>> visible;
+	std::vector<std::vector<float>> transforms;
+
+	// OpenGL buffers are created once per share group of windows, normally one group for the whole game, and
+	// deleted with the batch
+	struct GpuGeometry {
+		GLuint positions;
+		GLuint normals;
+		GLuint texCoords;
+		GLuint indices;
+		int numIndices;
+	};
+	struct GpuBuffers {
+		GLuint instanceTransforms;
+		std::vector<GpuGeometry> levels;
+	};
+	std::map<int, GpuBuffers> buffers;
+
+	// Instancing shader, compiled once per share group and used by every batch
+	struct GpuProgram {
+		GLuint program;
+		GLint transformAttrib;
+		GLint lightOnUniform;
+		GLint useTextureUniform;
+		bool valid;
+	};
+	static std::map<int, GpuProgram> programs;
+
+	GpuBuffers& getBuffers(int group);
+	void drawInstanced(chai3d::cRenderOptions& a_options, const GpuProgram& program, GpuBuffers& gpu, int level);
+	void drawSeparately(chai3d::cRenderOptions& a_options, int level);
+
+	static bool instancingSupported();
+	static const GpuProgram& getProgram(int group);
+	static GpuGeometry upload(chai3d::cMesh* mesh);
+	static void deleteBuffers(GpuBuffers& gpu);
+	static GLuint compileProgram();
+};
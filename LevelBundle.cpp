@@ -0,0 +1,461 @@
+#include "LevelBundle.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <sys/stat.h>
+#include <vector>
+
+#include "chai3d.h"
+
+#include "AssetLoader.h"
+#include "ContentReadWrite.h"
+#include "GeometryCache.h"
+#include "LevelOfDetail.h"
+#include "MappedFile.h"
+#include "MeshFile.h"
+#include "StartupTrace.h"
+#include "TextureCache.h"
+
+std::set<std::string> LevelBundle::loaded;
+
+// Layout: bundle header, table of contents, then each entry's data starting at a multiple of 8 bytes
+static const char magic[4] = { 'H', 'L', 'V', 'L' };
+static const uint32_t version = 1;
+
+enum class EntryType : uint32_t {
+	WORLD,		// World JSON text, null terminated
+	MESH,		// Compiled mesh
+	LEVEL,		// Compiled reduced level of detail of a mesh
+	IMAGE		// Image header followed by decoded pixels
+};
+
+struct BundleHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t numEntries;
+	uint32_t padding;
+};
+
+struct TocEntry {
+	EntryType type;
+	uint32_t level;
+	int64_t sourceTime;
+	uint64_t hash;
+	uint64_t offset;
+	uint64_t size;
+	char source[128];
+};
+
+struct ImageHeader {
+	uint32_t width;
+	uint32_t height;
+	uint32_t format;
+	uint32_t type;
+};
+
+// Returns the modification time of a file, or -1 if it does not exist
+static int64_t modificationTime(const std::string& filename) {
+
+	struct stat info;
+	if (stat(filename.c_str(), &info) != 0) {
+		return -1;
+	}
+	return (int64_t)info.st_mtime;
+}
+
+// Reads the header and table of contents of a mapped bundle. Returns false if it is missing, from another version or
+// has entries outside the file
+static bool readToc(const MappedFile& file, std::vector<TocEntry>& toc) {
+
+	if (file.data == nullptr || file.size < sizeof(BundleHeader)) {
+		return false;
+	}
+
+	BundleHeader header;
+	memcpy(&header, file.data, sizeof(BundleHeader));
+	if (memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version) {
+		return false;
+	}
+	if (sizeof(BundleHeader) + (size_t)header.numEntries * sizeof(TocEntry) > file.size) {
+		return false;
+	}
+
+	toc.resize(header.numEntries);
+	memcpy(toc.data(), file.data + sizeof(BundleHeader), header.numEntries * sizeof(TocEntry));
+	for (TocEntry& entry : toc) {
+
+		entry.source[sizeof(entry.source) - 1] = 0;
+		if (entry.offset > file.size || entry.size > file.size - entry.offset) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Returns if the source of an entry is unchanged since the entry was built. A file with a new modification time
+// still counts as unchanged if its contents hash matches, as after a checkout or a save without edits
+static bool isUnchanged(const TocEntry& entry) {
+
+	int64_t time = modificationTime(entry.source);
+	if (time == entry.sourceTime) {
+		return true;
+	}
+	unsigned long long hash;
+	return time >= 0 && entry.hash != 0 && GeometryCache::hashFile(entry.source, hash) && hash == entry.hash;
+}
+
+// Returns the bundle file for a world file
+std::string LevelBundle::bundleFile(const std::string& worldFile) {
+	return worldFile.substr(0, worldFile.find_last_of('.')) + ".bundle";
+}
+
+// Returns the world document, loading its assets from the bundle into the caches. A missing or stale bundle is
+// rebuilt first, and if that fails the world is read on its own and assets load from their files. If the limit stops
+// the load, the world is returned with whatever assets reached the caches
+rapidjson::Document LevelBundle::loadWorld(const std::string& worldFile, LoadLimit* limit) {
+
+	rapidjson::Document d;
+	if (load(worldFile, d, limit)) {
+		return d;
+	}
+	if (limit != nullptr && limit->stopped()) {
+		return ContentReadWrite::readJSON(worldFile);
+	}
+
+	if (compile(worldFile, limit) && load(worldFile, d, limit)) {
+		return d;
+	}
+	if (limit != nullptr && limit->stopped()) {
+		return ContentReadWrite::readJSON(worldFile);
+	}
+
+	std::cout << "Could not use level bundle for " << worldFile << ", loading files separately" << std::endl;
+	return ContentReadWrite::readJSON(worldFile);
+}
+
+// Reads a bundle with a single mapping. Returns false if it is missing, from another version or out of date. Assets
+// not decoded when the limit stops are skipped, and the bundle is read again by the next load
+bool LevelBundle::load(const std::string& worldFile, rapidjson::Document& d, LoadLimit* limit) {
+
+	std::string filename = bundleFile(worldFile);
+	chai3d::cPrecisionClock clock;
+	clock.start(true);
+
+	// Any entry whose source has a new modification time sends the bundle back to compile, which only rebuilds the
+	// entries that really changed
+	MappedFile file(filename);
+	std::vector<TocEntry> toc;
+	if (!readToc(file, toc)) {
+		return false;
+	}
+	for (const TocEntry& entry : toc) {
+		if (modificationTime(entry.source) != entry.sourceTime) {
+			return false;
+		}
+	}
+
+	// Assets are only taken once per run, later loads just need the world
+	bool loadAssets = (loaded.find(filename) == loaded.end());
+	bool foundWorld = false;
+
+	// Entries are decoded on the loading pool, each into its own slot, then added to the caches in table order
+	std::vector<const TocEntry*> assets;
+	for (const TocEntry& entry : toc) {
+
+		const char* data = file.data + entry.offset;
+		if (entry.type == EntryType::WORLD) {
+			if (entry.size == 0 || data[entry.size - 1] != 0) {
+				return false;
+			}
+			d = ContentReadWrite::parseJSON(data);
+			foundWorld = true;
+		}
+		else if (loadAssets) {
+			assets.push_back(&entry);
+		}
+	}
+
+	AssetLoader::addTime(LoadStage::READ, clock.getCurrentTimeSeconds());
+
+	std::vector<chai3d::cMultiMesh*> meshes(assets.size(), nullptr);
+	std::vector<chai3d::cImagePtr> images(assets.size());
+	const std::atomic<bool>* cancel = (limit != nullptr) ? limit->getFlag() : nullptr;
+	AssetLoader::getPool().parallelFor((int)assets.size(), [&](int i) {
+
+		const TocEntry& entry = *assets[i];
+		const char* data = file.data + entry.offset;
+		chai3d::cPrecisionClock clock;
+		clock.start(true);
+
+		TracePhase phase(entry.type == EntryType::IMAGE ? "image decode" : "mesh decode", entry.source);
+		if (entry.type == EntryType::MESH || entry.type == EntryType::LEVEL) {
+			meshes[i] = MeshFile::load(data, (size_t)entry.size);
+			AssetLoader::addTime(entry.type == EntryType::MESH ? LoadStage::MESH_PARSE : LoadStage::LEVEL_OF_DETAIL, clock.getCurrentTimeSeconds());
+
+			if (entry.type == EntryType::MESH && meshes[i] != nullptr) {
+				double parsed = clock.getCurrentTimeSeconds();
+				TracePhase treePhase("collision tree", entry.source);
+				GeometryCache::buildCollisionTree(meshes[i]);
+				AssetLoader::addTime(LoadStage::COLLISION_TREE, clock.getCurrentTimeSeconds() - parsed);
+			}
+		}
+		else if (entry.type == EntryType::IMAGE && entry.size >= sizeof(ImageHeader)) {
+
+			ImageHeader imageHeader;
+			memcpy(&imageHeader, data, sizeof(ImageHeader));
+
+			chai3d::cImagePtr image = chai3d::cImage::create();
+			image->allocate(imageHeader.width, imageHeader.height, imageHeader.format, imageHeader.type);
+			if (image->getSizeInBytes() == entry.size - sizeof(ImageHeader)) {
+				memcpy(image->getData(), data + sizeof(ImageHeader), image->getSizeInBytes());
+				images[i] = image;
+			}
+			AssetLoader::addTime(LoadStage::IMAGE_DECODE, clock.getCurrentTimeSeconds());
+		}
+
+		if (limit != nullptr && meshes[i] != nullptr) {
+			limit->addBytes(GeometryCache::estimateBytes(meshes[i]));
+		}
+		else if (limit != nullptr && images[i] != nullptr) {
+			limit->addBytes(images[i]->getSizeInBytes());
+		}
+	}, cancel);
+
+	// A level of detail set is only used whole, so one cut short by the limit is dropped
+	bool stopped = (limit != nullptr && limit->stopped());
+
+	// Levels are stored in order, finest first
+	std::map<std::string, std::vector<chai3d::cMultiMesh*>> levels;
+	for (size_t i = 0; i < assets.size(); i++) {
+
+		const TocEntry& entry = *assets[i];
+		if (entry.type == EntryType::MESH && meshes[i] != nullptr) {
+			GeometryCache::addPrototype(entry.source, entry.hash, meshes[i]);
+		}
+		else if (entry.type == EntryType::LEVEL && meshes[i] != nullptr && !stopped) {
+			levels[entry.source].push_back(meshes[i]);
+		}
+		else {
+			delete meshes[i];
+		}
+		if (entry.type == EntryType::IMAGE && images[i] != nullptr) {
+			TextureCache::addImage(entry.source, images[i]);
+		}
+	}
+	for (const std::pair<const std::string, std::vector<chai3d::cMultiMesh*>>& l : levels) {
+		LevelOfDetail::addLevels(l.first, l.second);
+	}
+
+	if (!stopped) {
+		loaded.insert(filename);
+	}
+	return foundWorld;
+}
+
+// Builds the table of contents and data of a world's bundle. Assets whose entries in the existing bundle are still
+// unchanged are copied from it as they are, so only new or changed assets are parsed and decoded again. Returns
+// false if the world or an asset cannot be read, or if the limit stops it
+static bool buildEntries(const std::string& worldFile, LoadLimit* limit, std::vector<TocEntry>& toc, std::vector<std::string>& blobs, int& rebuilt) {
+
+	std::ifstream worldIn(worldFile, std::ios::binary);
+	if (!worldIn.is_open()) {
+		std::cout << "Could not open world " << worldFile << std::endl;
+		return false;
+	}
+	std::string worldText((std::istreambuf_iterator<char>(worldIn)), std::istreambuf_iterator<char>());
+
+	rapidjson::Document d = ContentReadWrite::parseJSON(worldText.c_str());
+	if (!d.IsObject() || !d.HasMember("entities")) {
+		return false;
+	}
+
+	// Entries of the existing bundle by source file, a mesh's entry followed by its levels in table order
+	MappedFile previous(LevelBundle::bundleFile(worldFile));
+	std::vector<TocEntry> previousToc;
+	if (!readToc(previous, previousToc)) {
+		previousToc.clear();
+	}
+	std::multimap<std::string, const TocEntry*> previousEntries;
+	for (const TocEntry& entry : previousToc) {
+		if (entry.type != EntryType::WORLD) {
+			previousEntries.insert(std::make_pair(std::string(entry.source), &entry));
+		}
+	}
+
+	// Adds an entry to the table of contents with the modification time of its source file
+	auto addEntry = [&](EntryType type, const std::string& source, uint32_t level, uint64_t hash, const std::string& blob) {
+
+		TocEntry entry;
+		memset(&entry, 0, sizeof(TocEntry));
+		entry.type = type;
+		entry.level = level;
+		entry.sourceTime = modificationTime(source);
+		entry.hash = hash;
+		entry.size = blob.size();
+		source.copy(entry.source, sizeof(entry.source) - 1);
+
+		toc.push_back(entry);
+		blobs.push_back(blob);
+		return source.size() < sizeof(entry.source);
+	};
+
+	// Copies the entries of an asset from the existing bundle if its source is unchanged. Returns false if the
+	// asset has to be built again
+	auto reuseEntries = [&](EntryType type, const std::string& source) {
+
+		auto range = previousEntries.equal_range(source);
+		if (range.first == range.second || range.first->second->type != type || !isUnchanged(*range.first->second)) {
+			return false;
+		}
+		int64_t time = modificationTime(source);
+		for (auto it = range.first; it != range.second; ++it) {
+			TocEntry entry = *it->second;
+			entry.sourceTime = time;
+			toc.push_back(entry);
+			blobs.push_back(std::string(previous.data + entry.offset, (size_t)entry.size));
+		}
+		return true;
+	};
+
+	bool ok = addEntry(EntryType::WORLD, worldFile, 0, 0, worldText + '\0');
+
+	std::set<std::string> meshFiles;
+	std::set<std::string> textureFiles;
+	rapidjson::Value& entities = d["entities"];
+	for (rapidjson::SizeType i = 0; i < entities.Size(); i++) {
+		meshFiles.insert(entities[i]["filename"].GetString());
+		if (entities[i].HasMember("texture")) {
+			textureFiles.insert(entities[i]["texture"].GetString());
+		}
+	}
+
+	for (const std::string& obj : meshFiles) {
+
+		if (limit != nullptr && limit->stopped()) {
+			return false;
+		}
+		if (reuseEntries(EntryType::MESH, obj)) {
+			continue;
+		}
+		rebuilt++;
+
+		unsigned long long hash;
+		chai3d::cMultiMesh* mesh = nullptr;
+		std::string compiled = MeshFile::compiledFile(obj);
+		if (MeshFile::isUpToDate(compiled, obj)) {
+			mesh = MeshFile::load(compiled);
+		}
+		if (mesh == nullptr) {
+			mesh = new chai3d::cMultiMesh();
+			if (!mesh->loadFromFile(obj)) {
+				std::cout << "Could not load mesh " << obj << std::endl;
+				delete mesh;
+				return false;
+			}
+		}
+		if (!GeometryCache::hashFile(obj, hash)) {
+			delete mesh;
+			return false;
+		}
+
+		std::ostringstream out;
+		MeshFile::save(out, mesh);
+		ok = addEntry(EntryType::MESH, obj, 0, hash, out.str()) && ok;
+
+		// Levels stay in the level of detail cache for this run
+		const std::vector<chai3d::cMultiMesh*>& levels = LevelOfDetail::getLevels(obj, mesh);
+		for (size_t l = 0; l < levels.size(); l++) {
+			std::ostringstream levelOut;
+			MeshFile::save(levelOut, levels[l]);
+			ok = addEntry(EntryType::LEVEL, obj, (uint32_t)(l + 1), hash, levelOut.str()) && ok;
+		}
+		delete mesh;
+	}
+
+	for (const std::string& texture : textureFiles) {
+
+		if (limit != nullptr && limit->stopped()) {
+			return false;
+		}
+		if (reuseEntries(EntryType::IMAGE, texture)) {
+			continue;
+		}
+		rebuilt++;
+
+		unsigned long long hash;
+		chai3d::cImagePtr image = chai3d::cImage::create();
+		if (!image->loadFromFile(texture) || !GeometryCache::hashFile(texture, hash)) {
+			std::cout << "Could not load image " << texture << std::endl;
+			return false;
+		}
+
+		ImageHeader imageHeader;
+		imageHeader.width = image->getWidth();
+		imageHeader.height = image->getHeight();
+		imageHeader.format = image->getFormat();
+		imageHeader.type = image->getType();
+
+		std::string blob((const char*)&imageHeader, sizeof(ImageHeader));
+		blob.append((const char*)image->getData(), image->getSizeInBytes());
+		ok = addEntry(EntryType::IMAGE, texture, 0, hash, blob) && ok;
+	}
+
+	if (!ok) {
+		std::cout << "Asset path too long for level bundle " << worldFile << std::endl;
+		return false;
+	}
+	return true;
+}
+
+// Builds or updates the bundle for a world file, rebuilding only the assets that changed since it was last built.
+// Returns false if the world or any asset cannot be read or written, or if the limit stops it before every asset
+// is packed
+bool LevelBundle::compile(const std::string& worldFile, LoadLimit* limit) {
+
+	// The existing bundle is read and closed before it is written over
+	std::vector<TocEntry> toc;
+	std::vector<std::string> blobs;
+	int rebuilt = 0;
+	if (!buildEntries(worldFile, limit, toc, blobs, rebuilt)) {
+		return false;
+	}
+
+	// Place entries after the table of contents
+	uint64_t offset = sizeof(BundleHeader) + toc.size() * sizeof(TocEntry);
+	for (TocEntry& entry : toc) {
+		offset = (offset + 7) & ~(uint64_t)7;
+		entry.offset = offset;
+		offset += entry.size;
+	}
+
+	std::string filename = bundleFile(worldFile);
+	std::ofstream out(filename, std::ios::binary);
+	if (!out.is_open()) {
+		std::cout << "Could not write level bundle " << filename << std::endl;
+		return false;
+	}
+
+	BundleHeader header;
+	memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.numEntries = (uint32_t)toc.size();
+	header.padding = 0;
+	out.write((const char*)&header, sizeof(BundleHeader));
+	out.write((const char*)toc.data(), toc.size() * sizeof(TocEntry));
+
+	uint64_t position = sizeof(BundleHeader) + toc.size() * sizeof(TocEntry);
+	for (size_t i = 0; i < toc.size(); i++) {
+		std::string padding((size_t)(toc[i].offset - position), '\0');
+		out.write(padding.data(), padding.size());
+		out.write(blobs[i].data(), blobs[i].size());
+		position = toc[i].offset + toc[i].size;
+	}
+
+	std::cout << "Compiled " << filename << " (" << toc.size() << " entries, " << rebuilt << " assets rebuilt, " << chai3d::cStr(position / (1024.0 * 1024.0), 2) << " MB)" << std::endl;
+	return out.good();
+}
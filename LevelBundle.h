@@ -0,0 +1,26 @@
+#pragma once
+
+#include <rapidjson/document.h>
+
+#include <set>
+#include <string>
+
+class LoadLimit;
+
+// Class that packs a world file with every mesh, level of detail and decoded texture it references into one bundle,
+// worlds/level.json becomes worlds/level.bundle. A bundle starts with a table of contents recording each entry's
+// source file, modification time and contents hash, so when a source changes only its own entries are rebuilt
+class LevelBundle {
+
+public:
+	static rapidjson::Document loadWorld(const std::string& worldFile, LoadLimit* limit = nullptr);
+	static bool compile(const std::string& worldFile, LoadLimit* limit = nullptr);
+
+	static std::string bundleFile(const std::string& worldFile);
+
+private:
+	// Bundles whose assets are already in the caches this run
+	static std::set<std::string> loaded;
+
+	static bool load(const std::string& worldFile, rapidjson::Document& d, LoadLimit* limit);
+};
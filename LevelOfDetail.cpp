@@ -0,0 +1,80 @@
+#include "LevelOfDetail.h"
+
+#include "Constants.h"
+#include "MeshFile.h"
+#include "MeshSimplifier.h"
+
+std::map<std::string, std::vector<chai3d::cMultiMesh*>> LevelOfDetail::cache;
+
+// Fraction of the full triangle count kept at each reduced level
+static const double levelRatios[] = { 0.4, 0.12 };
+static const int numReducedLevels = 2;
+
+// Returns the reduced levels for a mesh, coarsest last. Empty for meshes too small or complex to reduce
+const std::vector<chai3d::cMultiMesh*>& LevelOfDetail::getLevels(const std::string& objFile, chai3d::cMultiMesh* fullMesh) {
+
+	auto it = cache.find(objFile);
+	if (it != cache.end()) {
+		return it->second;
+	}
+	return cache[objFile] = buildLevels(objFile, fullMesh);
+}
+
+// Returns if the levels for a file are cached
+bool LevelOfDetail::hasLevels(const std::string& objFile) {
+	return cache.find(objFile) != cache.end();
+}
+
+// Loads or generates the reduced levels for a mesh without touching the cache, so it can run on any thread. If
+// cancel is set before the last level, the levels built so far are deleted and none are returned
+std::vector<chai3d::cMultiMesh*> LevelOfDetail::buildLevels(const std::string& objFile, chai3d::cMultiMesh* fullMesh, const std::atomic<bool>* cancel) {
+
+	std::vector<chai3d::cMultiMesh*> levels;
+	if (fullMesh->getNumMeshes() != 1 || fullMesh->getNumTriangles() < (unsigned int)Constants::lodMinTriangles) {
+		return levels;
+	}
+
+	for (int i = 0; i < numReducedLevels; i++) {
+
+		if (cancel != nullptr && *cancel) {
+			for (chai3d::cMultiMesh* level : levels) {
+				delete level;
+			}
+			levels.clear();
+			break;
+		}
+
+		// Reuse the level cached on disk unless the OBJ has changed since
+		std::string filename = levelFile(objFile, i + 1);
+		chai3d::cMultiMesh* level = nullptr;
+		if (MeshFile::isUpToDate(filename, objFile)) {
+			level = MeshFile::load(filename);
+		}
+		if (level == nullptr || level->getNumMeshes() != 1) {
+			delete level;
+			level = new chai3d::cMultiMesh();
+			level->addMesh(MeshSimplifier::simplify(fullMesh->getMesh(0), levelRatios[i]));
+			level->computeBoundaryBox(true);
+			MeshFile::save(filename, level);
+		}
+		levels.push_back(level);
+	}
+	return levels;
+}
+
+// Adds levels loaded elsewhere, such as from a level bundle, taking ownership unless the file already has levels
+void LevelOfDetail::addLevels(const std::string& objFile, const std::vector<chai3d::cMultiMesh*>& levels) {
+
+	if (cache.find(objFile) != cache.end()) {
+		for (chai3d::cMultiMesh* level : levels) {
+			delete level;
+		}
+		return;
+	}
+	cache[objFile] = levels;
+}
+
+// Returns the cache file of a level, models/coin.obj becomes models/coin.lod1.mesh
+std::string LevelOfDetail::levelFile(const std::string& objFile, int level) {
+	return objFile.substr(0, objFile.find_last_of('.')) + ".lod" + std::to_string(level) + ".mesh";
+}
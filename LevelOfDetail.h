@@ -0,0 +1,24 @@
+#pragma once
+
+#include "chai3d.h"
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+// Class that builds reduced detail copies of entity meshes for rendering. Levels are cached in memory per OBJ file
+// and on disk next to the asset. Haptics always use the full resolution mesh
+class LevelOfDetail {
+
+public:
+	static const std::vector<chai3d::cMultiMesh*>& getLevels(const std::string& objFile, chai3d::cMultiMesh* fullMesh);
+	static bool hasLevels(const std::string& objFile);
+	static void addLevels(const std::string& objFile, const std::vector<chai3d::cMultiMesh*>& levels);
+	static std::vector<chai3d::cMultiMesh*> buildLevels(const std::string& objFile, chai3d::cMultiMesh* fullMesh, const std::atomic<bool>* cancel = nullptr);
+
+private:
+	static std::map<std::string, std::vector<chai3d::cMultiMesh*>> cache;
+
+	static std::string levelFile(const std::string& objFile, int level);
+};
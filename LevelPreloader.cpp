@@ -0,0 +1,90 @@
+#include "LevelPreloader.h"
+
+#include <iostream>
+
+#include "AssetLoader.h"
+#include "Constants.h"
+#include "LevelBundle.h"
+#include "WorldLoader.h"
+
+// Starts loading the levels in the background
+LevelPreloader::LevelPreloader(const std::vector<std::string>& levelFiles) : limit(Constants::preloadBudgetMB) {
+
+	for (const std::string& file : levelFiles) {
+		levels.push_back({ file, {}, 0.0, false });
+	}
+	thread = std::thread(&LevelPreloader::run, this);
+}
+
+// Stops loading and deletes any level that was not taken
+LevelPreloader::~LevelPreloader() {
+
+	stop();
+	for (Level& level : levels) {
+		for (Entity* e : level.entities) {
+			delete e;
+		}
+	}
+}
+
+// Cancels loading and waits for the preload thread
+void LevelPreloader::stop() {
+
+	limit.cancel();
+	if (thread.joinable()) {
+		thread.join();
+	}
+}
+
+// Stops preloading and hands over the entities and time limit of a level. Returns false if the level was not fully
+// loaded, in which case it should be loaded normally, helped by whatever assets reached the caches
+bool LevelPreloader::take(const std::string& levelFile, std::vector<Entity*>& entities, double& time) {
+
+	stop();
+
+	for (Level& level : levels) {
+		if (level.file == levelFile && level.ready) {
+			entities = level.entities;
+			time = level.time;
+			level.entities.clear();
+			return true;
+		}
+	}
+	return false;
+}
+
+// Loads each level in turn until cancelled or over budget
+void LevelPreloader::run() {
+
+	limit.countCaches();
+	for (Level& level : levels) {
+
+		if (limit.isOverBudget()) {
+			std::cout << "Preloading stopped at " << chai3d::cStr(limit.getUsedMB(), 1) << " MB, over the budget of " << Constants::preloadBudgetMB << " MB" << std::endl;
+			return;
+		}
+		if (limit.stopped()) {
+			return;
+		}
+
+		AssetLoader::resetTimings();
+		chai3d::cPrecisionClock clock;
+		clock.start(true);
+
+		// Segmented worlds stream their entities during the race instead. A load that stopped is reported at the top
+		// of the loop
+		rapidjson::Document d = LevelBundle::loadWorld(level.file, &limit);
+		if (limit.stopped() || WorldLoader::isSegmented(d)) {
+			continue;
+		}
+
+		level.time = WorldLoader::loadWorld(std::move(d), level.entities, &limit);
+		if (limit.stopped()) {
+			continue;
+		}
+		level.ready = true;
+
+		std::cout << "Preloaded " << level.file << std::endl;
+		AssetLoader::printTimings(clock.getCurrentTimeSeconds());
+	}
+}
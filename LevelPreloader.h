@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AssetLoader.h"
+#include "Entity.h"
+
+// Loads candidate levels on a background thread while the menu is shown, in the order given. Loading stops part way
+// through an asset step if cancelled, or as soon as the assets loaded take the caches over the preload memory
+// budget. Until take is called the caches belong to the preload thread, so the main thread must not load assets in
+// the meantime
+class LevelPreloader {
+
+public:
+	LevelPreloader(const std::vector<std::string>& levelFiles);
+	~LevelPreloader();
+
+	bool take(const std::string& levelFile, std::vector<Entity*>& entities, double& time);
+
+private:
+	struct Level {
+		std::string file;
+		std::vector<Entity*> entities;
+		double time;
+		bool ready;
+	};
+	std::vector<Level> levels;
+
+	std::thread thread;
+	LoadLimit limit;
+
+	void run();
+	void stop();
+};
@@ -4,10 +4,13 @@ Magnet::Magnet(std::string filename, View view, chai3d::cTransform transform, do
 	type = Type::MAGNET;
 }
 
-// Returns a force that exerts magnetic attraction on the cursor
-chai3d::cVector3d Magnet::interact(chai3d::cToolCursor* tool) {
+// Returns the magnet strength
+double Magnet::getStrength() const {
+	return strength;
+}
 
-	chai3d::cVector3d toolPos = tool->getLocalTransform() * tool->m_hapticPoint->m_sphereProxy->getLocalPos();
+// Returns a force that exerts magnetic attraction from a magnet mesh on the cursor, at any distance
+chai3d::cVector3d Magnet::attraction(chai3d::cMultiMesh* mesh, const chai3d::cVector3d& toolPos, double strength) {
 
 	// Get triangles and vertices of the mesh
 	chai3d::cTriangleArrayPtr tris = mesh->getMesh(0)->m_triangles;
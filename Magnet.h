@@ -8,8 +8,9 @@ class Magnet : public Entity {
 public:
 	Magnet(std::string filename, View view, chai3d::cTransform transform, double strength);
 
-	virtual chai3d::cVector3d interact(chai3d::cToolCursor* tool);
-	virtual bool insideForInteraction() { return false; }
+	double getStrength() const;
+
+	static chai3d::cVector3d attraction(chai3d::cMultiMesh* mesh, const chai3d::cVector3d& toolPos, double strength);
 
 private:
 	double strength;
@@ -0,0 +1,74 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Maps the whole file for reading
+MappedFile::MappedFile(const std::string& filename) : data(nullptr), size(0), file(nullptr), mapping(nullptr) {
+
+#ifdef _WIN32
+	HANDLE f = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (f == INVALID_HANDLE_VALUE) {
+		return;
+	}
+	file = f;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(f, &fileSize) || fileSize.QuadPart == 0) {
+		return;
+	}
+	size = (size_t)fileSize.QuadPart;
+
+	mapping = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping != nullptr) {
+		data = (const char*)MapViewOfFile((HANDLE)mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) == 0 && info.st_size > 0) {
+		void* mapped = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped != MAP_FAILED) {
+			data = (const char*)mapped;
+			size = (size_t)info.st_size;
+		}
+	}
+	close(fd);
+#endif
+
+	if (data == nullptr) {
+		size = 0;
+	}
+}
+
+// Unmaps the file
+MappedFile::~MappedFile() {
+
+#ifdef _WIN32
+	if (data != nullptr) {
+		UnmapViewOfFile(data);
+	}
+	if (mapping != nullptr) {
+		CloseHandle((HANDLE)mapping);
+	}
+	if (file != nullptr) {
+		CloseHandle((HANDLE)file);
+	}
+#else
+	if (data != nullptr) {
+		munmap((void*)data, size);
+	}
+#endif
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+
+// Read only view of a whole file through the operating system's memory mapping. Data is null if the file could not
+// be mapped
+class MappedFile {
+
+public:
+	MappedFile(const std::string& filename);
+	~MappedFile();
+
+	const char* data;
+	size_t size;
+
+private:
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Windows file and mapping handles
+	void* file;
+	void* mapping;
+};
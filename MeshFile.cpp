@@ -0,0 +1,205 @@
+#include "MeshFile.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sys/stat.h>
+
+#include "ContentReadWrite.h"
+#include "MappedFile.h"
+
+// Layout: file header, then for each mesh a mesh header followed by float positions[3 * numVertices],
+// float normals[3 * numVertices], float texCoords[2 * numVertices] and uint32 indices[3 * numTriangles]
+static const char magic[4] = { 'H', 'M', 'S', 'H' };
+static const uint32_t version = 1;
+
+struct FileHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t numMeshes;
+};
+
+struct MeshHeader {
+	uint32_t numVertices;
+	uint32_t numTriangles;
+};
+
+// Loads a compiled mesh. Returns null if the file is missing, from another version or truncated
+chai3d::cMultiMesh* MeshFile::load(const std::string& filename) {
+
+	MappedFile file(filename);
+	return load(file.data, file.size);
+}
+
+// Builds a mesh from compiled data in memory, such as a mapped file or a level bundle entry
+chai3d::cMultiMesh* MeshFile::load(const char* data, size_t size) {
+
+	if (data == nullptr || size < sizeof(FileHeader)) {
+		return nullptr;
+	}
+
+	FileHeader header;
+	memcpy(&header, data, sizeof(FileHeader));
+	if (memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version) {
+		return nullptr;
+	}
+
+	// Check every block fits before building anything
+	size_t offset = sizeof(FileHeader);
+	for (uint32_t m = 0; m < header.numMeshes; m++) {
+
+		if (offset + sizeof(MeshHeader) > size) {
+			return nullptr;
+		}
+		MeshHeader meshHeader;
+		memcpy(&meshHeader, data + offset, sizeof(MeshHeader));
+		offset += sizeof(MeshHeader) + 8 * sizeof(float) * (size_t)meshHeader.numVertices + 3 * sizeof(uint32_t) * (size_t)meshHeader.numTriangles;
+		if (offset > size) {
+			return nullptr;
+		}
+	}
+
+	chai3d::cMultiMesh* result = new chai3d::cMultiMesh();
+	offset = sizeof(FileHeader);
+	for (uint32_t m = 0; m < header.numMeshes; m++) {
+
+		MeshHeader meshHeader;
+		memcpy(&meshHeader, data + offset, sizeof(MeshHeader));
+		offset += sizeof(MeshHeader);
+
+		// All arrays hold 4 byte values and start at multiples of 4, so they are read in place
+		const float* positions = (const float*)(data + offset);
+		const float* normals = positions + 3 * meshHeader.numVertices;
+		const float* texCoords = normals + 3 * meshHeader.numVertices;
+		const uint32_t* indices = (const uint32_t*)(texCoords + 2 * meshHeader.numVertices);
+		offset += 8 * sizeof(float) * meshHeader.numVertices + 3 * sizeof(uint32_t) * meshHeader.numTriangles;
+
+		chai3d::cMesh* mesh = result->newMesh();
+		for (uint32_t i = 0; i < meshHeader.numVertices; i++) {
+			mesh->newVertex(chai3d::cVector3d(positions[3 * i], positions[3 * i + 1], positions[3 * i + 2]),
+				chai3d::cVector3d(normals[3 * i], normals[3 * i + 1], normals[3 * i + 2]),
+				chai3d::cVector3d(texCoords[2 * i], texCoords[2 * i + 1], 0.0));
+		}
+		for (uint32_t i = 0; i < meshHeader.numTriangles; i++) {
+			uint32_t a = indices[3 * i];
+			uint32_t b = indices[3 * i + 1];
+			uint32_t c = indices[3 * i + 2];
+			if (a >= meshHeader.numVertices || b >= meshHeader.numVertices || c >= meshHeader.numVertices) {
+				delete result;
+				return nullptr;
+			}
+			mesh->newTriangle(a, b, c);
+		}
+	}
+	result->computeBoundaryBox(true);
+
+	return result;
+}
+
+// Writes a mesh in the binary format. Returns false if the file cannot be written
+bool MeshFile::save(const std::string& filename, chai3d::cMultiMesh* mesh) {
+
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "Could not write compiled mesh " << filename << std::endl;
+		return false;
+	}
+	return save(file, mesh);
+}
+
+// Writes a mesh in the binary format to a stream. Sizes are multiples of 4 bytes
+bool MeshFile::save(std::ostream& file, chai3d::cMultiMesh* mesh) {
+
+	FileHeader header;
+	memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	header.numMeshes = (uint32_t)mesh->getNumMeshes();
+	file.write((const char*)&header, sizeof(FileHeader));
+
+	for (uint32_t m = 0; m < header.numMeshes; m++) {
+
+		chai3d::cVertexArrayPtr verts = mesh->getMesh(m)->m_vertices;
+		chai3d::cTriangleArrayPtr tris = mesh->getMesh(m)->m_triangles;
+
+		MeshHeader meshHeader;
+		meshHeader.numVertices = verts->getNumElements();
+		meshHeader.numTriangles = tris->getNumElements();
+		file.write((const char*)&meshHeader, sizeof(MeshHeader));
+
+		std::vector<float> positions;
+		std::vector<float> normals;
+		std::vector<float> texCoords;
+		for (uint32_t i = 0; i < meshHeader.numVertices; i++) {
+
+			chai3d::cVector3d p = verts->getLocalPos(i);
+			chai3d::cVector3d n = verts->getNormal(i);
+			chai3d::cVector3d t = verts->getTexCoord(i);
+
+			positions.insert(positions.end(), { (float)p.x(), (float)p.y(), (float)p.z() });
+			normals.insert(normals.end(), { (float)n.x(), (float)n.y(), (float)n.z() });
+			texCoords.insert(texCoords.end(), { (float)t.x(), (float)t.y() });
+		}
+
+		std::vector<uint32_t> indices;
+		for (uint32_t i = 0; i < meshHeader.numTriangles; i++) {
+			indices.insert(indices.end(), { tris->getVertexIndex0(i), tris->getVertexIndex1(i), tris->getVertexIndex2(i) });
+		}
+
+		file.write((const char*)positions.data(), positions.size() * sizeof(float));
+		file.write((const char*)normals.data(), normals.size() * sizeof(float));
+		file.write((const char*)texCoords.data(), texCoords.size() * sizeof(float));
+		file.write((const char*)indices.data(), indices.size() * sizeof(uint32_t));
+	}
+	return file.good();
+}
+
+// Returns the compiled file for an OBJ file
+std::string MeshFile::compiledFile(const std::string& objFile) {
+	return objFile.substr(0, objFile.find_last_of('.')) + ".mesh";
+}
+
+// Returns if a compiled file exists and is newer than the file it was built from
+bool MeshFile::isUpToDate(const std::string& compiled, const std::string& source) {
+
+	struct stat compiledInfo;
+	struct stat sourceInfo;
+	if (stat(compiled.c_str(), &compiledInfo) != 0 || stat(source.c_str(), &sourceInfo) != 0) {
+		return false;
+	}
+	return compiledInfo.st_mtime >= sourceInfo.st_mtime;
+}
+
+// Compiles every OBJ used by the provided world files. Returns the number of meshes that failed
+int MeshFile::compileWorlds(const std::vector<std::string>& worldFiles) {
+
+	std::set<std::string> objFiles;
+	for (const std::string& world : worldFiles) {
+
+		rapidjson::Document d = ContentReadWrite::readJSON(world);
+		if (!d.IsObject() || !d.HasMember("entities")) {
+			std::cout << "Could not read world " << world << std::endl;
+			continue;
+		}
+		rapidjson::Value& entities = d["entities"];
+		for (rapidjson::SizeType i = 0; i < entities.Size(); i++) {
+			objFiles.insert(entities[i]["filename"].GetString());
+		}
+	}
+
+	int failed = 0;
+	for (const std::string& obj : objFiles) {
+
+		chai3d::cMultiMesh* mesh = new chai3d::cMultiMesh();
+		if (!mesh->loadFromFile(obj) || !save(compiledFile(obj), mesh)) {
+			std::cout << "Failed to compile " << obj << std::endl;
+			failed++;
+		}
+		else {
+			std::cout << "Compiled " << obj << " (" << mesh->getNumTriangles() << " triangles)" << std::endl;
+		}
+		delete mesh;
+	}
+	return failed;
+}
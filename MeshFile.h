@@ -0,0 +1,24 @@
+#pragma once
+
+#include "chai3d.h"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Class that reads and writes the binary mesh format. A file holds, for each mesh, its vertex positions, normals,
+// texture coordinates and triangle indices as flat arrays, and is memory mapped when loaded so no text is parsed.
+// Compiled files sit next to their OBJ, models/coin.obj becomes models/coin.mesh
+class MeshFile {
+
+public:
+	static chai3d::cMultiMesh* load(const std::string& filename);
+	static chai3d::cMultiMesh* load(const char* data, size_t size);
+	static bool save(const std::string& filename, chai3d::cMultiMesh* mesh);
+	static bool save(std::ostream& file, chai3d::cMultiMesh* mesh);
+
+	static std::string compiledFile(const std::string& objFile);
+	static bool isUpToDate(const std::string& compiled, const std::string& source);
+
+	static int compileWorlds(const std::vector<std::string>& worldFiles);
+};
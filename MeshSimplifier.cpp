@@ -0,0 +1,242 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <map>
+#include <queue>
+#include <set>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+// Symmetric 4x4 matrix storing the sum of squared distances to a set of planes
+struct Quadric {
+	double a[10];
+
+	Quadric() { std::fill(a, a + 10, 0.0); }
+
+	Quadric(double nx, double ny, double nz, double d) {
+		a[0] = nx * nx; a[1] = nx * ny; a[2] = nx * nz; a[3] = nx * d;
+		a[4] = ny * ny; a[5] = ny * nz; a[6] = ny * d;
+		a[7] = nz * nz; a[8] = nz * d;
+		a[9] = d * d;
+	}
+
+	Quadric& operator+=(const Quadric& q) {
+		for (int i = 0; i < 10; i++) {
+			a[i] += q.a[i];
+		}
+		return *this;
+	}
+
+	double error(const chai3d::cVector3d& v) const {
+		double x = v.x(), y = v.y(), z = v.z();
+		return a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+		     + a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+		     + a[7] * z * z + 2 * a[8] * z
+		     + a[9];
+	}
+};
+
+// Candidate collapse of vertex "from" onto vertex "to"
+struct Collapse {
+	double cost;
+	int from;
+	int to;
+	int fromVersion;
+	int toVersion;
+
+	bool operator>(const Collapse& c) const { return cost > c.cost; }
+};
+
+}
+
+// Returns a new mesh with roughly ratio times the triangles of the source. Vertices are merged onto existing
+// ones so texture coordinates and normals are kept. Vertices split for texture seams are welded for the
+// simplification and keep their own attributes where they survive
+chai3d::cMesh* MeshSimplifier::simplify(chai3d::cMesh* source, double ratio) {
+
+	chai3d::cVertexArrayPtr verts = source->m_vertices;
+	chai3d::cTriangleArrayPtr tris = source->m_triangles;
+	int numVerts = verts->getNumElements();
+	int numTris = tris->getNumElements();
+
+	// Weld vertices that share a position
+	std::map<std::tuple<double, double, double>, int> positionToWeld;
+	std::vector<int> weldOf(numVerts);
+	std::vector<int> representative;
+	std::vector<chai3d::cVector3d> positions;
+	for (int i = 0; i < numVerts; i++) {
+
+		chai3d::cVector3d p = verts->getLocalPos(i);
+		auto key = std::make_tuple(p.x(), p.y(), p.z());
+		auto it = positionToWeld.find(key);
+
+		if (it == positionToWeld.end()) {
+			weldOf[i] = (int)positions.size();
+			positionToWeld[key] = weldOf[i];
+			representative.push_back(i);
+			positions.push_back(p);
+		}
+		else {
+			weldOf[i] = it->second;
+		}
+	}
+	int numWelded = (int)positions.size();
+
+	// Triangles over welded vertices, their plane quadrics and vertex adjacency
+	std::vector<int> triVerts(3 * numTris);
+	std::vector<int> triCorners(3 * numTris);
+	std::vector<bool> triAlive(numTris, true);
+	std::vector<Quadric> quadrics(numWelded);
+	std::vector<std::vector<int>> adjacent(numWelded);
+
+	for (int t = 0; t < numTris; t++) {
+
+		triCorners[3 * t + 0] = tris->getVertexIndex0(t);
+		triCorners[3 * t + 1] = tris->getVertexIndex1(t);
+		triCorners[3 * t + 2] = tris->getVertexIndex2(t);
+		for (int c = 0; c < 3; c++) {
+			triVerts[3 * t + c] = weldOf[triCorners[3 * t + c]];
+		}
+
+		chai3d::cVector3d p0 = positions[triVerts[3 * t + 0]];
+		chai3d::cVector3d n = (positions[triVerts[3 * t + 1]] - p0).cross(positions[triVerts[3 * t + 2]] - p0);
+		if (n.length() == 0.0) {
+			triAlive[t] = false;
+			continue;
+		}
+		n.normalize();
+
+		Quadric q(n.x(), n.y(), n.z(), -n.dot(p0));
+		for (int c = 0; c < 3; c++) {
+			quadrics[triVerts[3 * t + c]] += q;
+			adjacent[triVerts[3 * t + c]].push_back(t);
+		}
+	}
+
+	int aliveTris = (int)std::count(triAlive.begin(), triAlive.end(), true);
+	int targetTris = std::max(4, (int)(ratio * aliveTris));
+
+	std::vector<int> version(numWelded, 0);
+	std::vector<int> collapsedInto(numWelded, -1);
+
+	// Queues both directions of an edge, the cheaper will be taken first
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+	auto pushEdge = [&](int u, int v) {
+		Quadric q = quadrics[u];
+		q += quadrics[v];
+		queue.push({ q.error(positions[v]), u, v, version[u], version[v] });
+		queue.push({ q.error(positions[u]), v, u, version[v], version[u] });
+	};
+
+	std::set<std::pair<int, int>> edges;
+	for (int t = 0; t < numTris; t++) {
+		if (!triAlive[t]) continue;
+		for (int c = 0; c < 3; c++) {
+			int u = triVerts[3 * t + c];
+			int v = triVerts[3 * t + (c + 1) % 3];
+			edges.insert(std::make_pair(std::min(u, v), std::max(u, v)));
+		}
+	}
+	for (const std::pair<int, int>& e : edges) {
+		pushEdge(e.first, e.second);
+	}
+
+	while (aliveTris > targetTris && !queue.empty()) {
+
+		Collapse c = queue.top();
+		queue.pop();
+
+		// Skip collapses made stale by earlier ones
+		if (collapsedInto[c.from] != -1 || collapsedInto[c.to] != -1 ||
+		    version[c.from] != c.fromVersion || version[c.to] != c.toVersion) {
+			continue;
+		}
+
+		// Reject collapses that would flip a remaining triangle
+		bool flips = false;
+		for (int t : adjacent[c.from]) {
+
+			if (!triAlive[t]) continue;
+			int* tv = &triVerts[3 * t];
+			if (tv[0] == c.to || tv[1] == c.to || tv[2] == c.to) continue;
+
+			chai3d::cVector3d before = (positions[tv[1]] - positions[tv[0]]).cross(positions[tv[2]] - positions[tv[0]]);
+			chai3d::cVector3d p[3];
+			for (int k = 0; k < 3; k++) {
+				p[k] = (tv[k] == c.from) ? positions[c.to] : positions[tv[k]];
+			}
+			chai3d::cVector3d after = (p[1] - p[0]).cross(p[2] - p[0]);
+			if (before.dot(after) <= 0.0) {
+				flips = true;
+				break;
+			}
+		}
+		if (flips) {
+			continue;
+		}
+
+		// Collapse: move triangles onto the kept vertex and drop those that degenerate
+		collapsedInto[c.from] = c.to;
+		quadrics[c.to] += quadrics[c.from];
+		version[c.to]++;
+
+		for (int t : adjacent[c.from]) {
+
+			if (!triAlive[t]) continue;
+			int* tv = &triVerts[3 * t];
+			for (int k = 0; k < 3; k++) {
+				if (tv[k] == c.from) {
+					tv[k] = c.to;
+				}
+			}
+
+			if (tv[0] == tv[1] || tv[1] == tv[2] || tv[0] == tv[2]) {
+				triAlive[t] = false;
+				aliveTris--;
+			}
+			else {
+				adjacent[c.to].push_back(t);
+			}
+		}
+		adjacent[c.from].clear();
+
+		// Re-queue the edges around the kept vertex with updated costs
+		std::set<int> neighbours;
+		for (int t : adjacent[c.to]) {
+			if (!triAlive[t]) continue;
+			for (int k = 0; k < 3; k++) {
+				if (triVerts[3 * t + k] != c.to) {
+					neighbours.insert(triVerts[3 * t + k]);
+				}
+			}
+		}
+		for (int n : neighbours) {
+			pushEdge(c.to, n);
+		}
+	}
+
+	// Build the output mesh, reusing original vertices (and their attributes) where possible
+	chai3d::cMesh* result = new chai3d::cMesh();
+	std::vector<int> newIndex(numVerts, -1);
+
+	auto outputVertex = [&](int corner, int welded) {
+		int original = (weldOf[corner] == welded) ? corner : representative[welded];
+		if (newIndex[original] == -1) {
+			newIndex[original] = result->newVertex(verts->getLocalPos(original), verts->getNormal(original), verts->getTexCoord(original));
+		}
+		return newIndex[original];
+	};
+
+	for (int t = 0; t < numTris; t++) {
+		if (!triAlive[t]) continue;
+		int i0 = outputVertex(triCorners[3 * t + 0], triVerts[3 * t + 0]);
+		int i1 = outputVertex(triCorners[3 * t + 1], triVerts[3 * t + 1]);
+		int i2 = outputVertex(triCorners[3 * t + 2], triVerts[3 * t + 2]);
+		result->newTriangle(i0, i1, i2);
+	}
+	result->computeBoundaryBox(true);
+
+	return result;
+}
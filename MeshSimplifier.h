@@ -0,0 +1,10 @@
+#pragma once
+
+#include "chai3d.h"
+
+// Class for reducing the triangle count of a mesh by quadric error edge collapse
+class MeshSimplifier {
+
+public:
+	static chai3d::cMesh* simplify(chai3d::cMesh* source, double ratio);
+};
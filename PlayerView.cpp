@@ -1,11 +1,25 @@
 #include "PlayerView.h"
 
 #include "InputHandler.h"
+#include "Constants.h"
 
 std::map<GLFWwindow*, PlayerView*> PlayerView::windowToView;
+std::map<GLFWwindow*, int> PlayerView::shareGroups;
+int PlayerView::nextShareGroup = 0;
 
 // Creates a GLFW window for the player view
-PlayerView::PlayerView(const HapticsController& controller, GLFWmonitor* monitor, bool fullscreen, bool isMenu) : controller(controller), monitor(monitor), isMenu(isMenu) {
+PlayerView::PlayerView(const HapticsController* controller, GLFWmonitor* monitor, bool fullscreen, bool isMenu, SceneGraph* scene, View view) : controller(controller), monitor(monitor), isMenu(isMenu), scene(scene), view(view), offscreen(false), framePacer(nullptr) {
+
+	shadowQuality = ShadowQuality::VERY_HIGH;
+	maxShadowQuality = ShadowQuality::VERY_HIGH;
+	shadowBudgetMs = Constants::shadowBudgetMs;
+	shadowPassMs = 0.0;
+	lastShadowPassMs = 0.0;
+	shadowsValid = false;
+	shadowSceneVersion = 0;
+	useTimerQueries = false;
+	nextShadowQuery = 0;
+	pendingShadowQueries = 0;
 
 	// Get window width and height
 	const GLFWvidmode* mode = glfwGetVideoMode(monitor);
@@ -20,8 +34,9 @@ PlayerView::PlayerView(const HapticsController& controller, GLFWmonitor* monitor
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
 
 	// Create window
+	GLFWwindow* share = getShareContext();
 	if (fullscreen) {
-		window = glfwCreateWindow(mode->width, mode->height, "CHAI3D", monitor, NULL);
+		window = glfwCreateWindow(mode->width, mode->height, "CHAI3D", monitor, share);
 	}
 	else {
 		int w = 0.8 * mode->height;
@@ -34,7 +49,7 @@ PlayerView::PlayerView(const HapticsController& controller, GLFWmonitor* monitor
 			x += mode->width;
 		}
 
-		window = glfwCreateWindow(w, h, "CHAI3D", NULL, NULL);
+		window = glfwCreateWindow(w, h, "CHAI3D", NULL, share);
 		glfwSetWindowPos(window, x, y);
 	}
 
@@ -47,11 +62,14 @@ PlayerView::PlayerView(const HapticsController& controller, GLFWmonitor* monitor
 
 	// Add window view pair to mapping
 	windowToView[window] = this;
+	joinShareGroup(window, share);
 
 	// Set window properties
 	glfwGetWindowSize(window, &width, &height);
 	glfwMakeContextCurrent(window);
-	//glfwSwapInterval(1); - TODO not working right now because there are two windows
+
+	// Only one window should wait for vertical sync, otherwise each swap blocks in turn. See setSwapInterval
+	glfwSwapInterval(0);
 
 	// Set callback functions
 	glfwSetKeyCallback(window, InputHandler::keyCallback);
@@ -60,16 +78,108 @@ PlayerView::PlayerView(const HapticsController& controller, GLFWmonitor* monitor
 	setUpWorld();
 }
 
+// Creates a view that renders the scene into an offscreen framebuffer. A hidden window provides the OpenGL context,
+// so with Mesa's llvmpipe (LIBGL_ALWAYS_SOFTWARE=1) under a virtual display no GPU or monitor is needed
+PlayerView::PlayerView(SceneGraph* scene, View view, int width, int height) : controller(nullptr), monitor(nullptr), width(width), height(height), isMenu(false), scene(scene), view(view), offscreen(true), framePacer(nullptr) {
+
+	shadowQuality = ShadowQuality::VERY_HIGH;
+	maxShadowQuality = ShadowQuality::VERY_HIGH;
+	shadowBudgetMs = Constants::shadowBudgetMs;
+	shadowPassMs = 0.0;
+	lastShadowPassMs = 0.0;
+	shadowsValid = false;
+	shadowSceneVersion = 0;
+	useTimerQueries = false;
+	nextShadowQuery = 0;
+	pendingShadowQueries = 0;
+
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+	GLFWwindow* share = getShareContext();
+	window = glfwCreateWindow(width, height, "CHAI3D", NULL, share);
+
+	if (!window) {
+		std::cerr << "failed to create offscreen GLFW context" << std::endl;
+		glfwTerminate();
+		exit(-1);
+	}
+	windowToView[window] = this;
+	joinShareGroup(window, share);
+	glfwMakeContextCurrent(window);
+	glfwSwapInterval(0);
+
+	setUpWorld();
+
+	frameBuffer = chai3d::cFrameBuffer::create();
+	frameBuffer->setup(camera, width, height, true, true);
+}
+
 // Closes the GLFW window
 PlayerView::~PlayerView() {
+
+	// Fences and queries belong to this window's context
+	glfwMakeContextCurrent(window);
+	if (framePacer != nullptr && useTimerQueries) {
+		glDeleteQueries(numShadowQueries, shadowQueries);
+	}
+	delete framePacer;
+
+	// The last window of a share group takes the group's shared objects with it
+	int group = getShareGroup(window);
+	windowToView.erase(window);
+	shareGroups.erase(window);
+	if (getGroupWindow(group) == nullptr) {
+		InstanceBatch::releaseShareGroup(group);
+	}
 	glfwDestroyWindow(window);
 }
 
-// Initializes geometry of the world
+// Returns an existing window for new windows to share textures and buffers with, so each is uploaded once
+GLFWwindow* PlayerView::getShareContext() {
+
+	if (windowToView.empty()) {
+		return NULL;
+	}
+	return windowToView.begin()->first;
+}
+
+// Records the share group of a new window: the group of the window it shares with, or a new group
+void PlayerView::joinShareGroup(GLFWwindow* window, GLFWwindow* share) {
+
+	auto it = shareGroups.find(share);
+	shareGroups[window] = (it != shareGroups.end()) ? it->second : nextShareGroup++;
+}
+
+// Returns the share group of a window, or -1 for a window not made by a view. Objects such as buffers and shader
+// programs created in one window of a group can be used in all of them
+int PlayerView::getShareGroup(GLFWwindow* window) {
+
+	auto it = shareGroups.find(window);
+	return it != shareGroups.end() ? it->second : -1;
+}
+
+// Returns a window in a share group, or null once every window of the group is destroyed, along with its objects
+GLFWwindow* PlayerView::getGroupWindow(int group) {
+
+	for (const std::pair<GLFWwindow* const, int>& g : shareGroups) {
+		if (g.second == group) {
+			return g.first;
+		}
+	}
+	return nullptr;
+}
+
+// Initializes geometry of the world. Game views add their camera and lights to the shared scene
 void PlayerView::setUpWorld() {
 
-	world = new chai3d::cWorld();
-	world->setGhostEnabled(true);
+	if (scene != nullptr) {
+		world = scene;
+	}
+	else {
+		world = new chai3d::cWorld();
+		world->setGhostEnabled(true);
+	}
 
 	// Set up camera
 	camera = new chai3d::cCamera(world);
@@ -89,7 +199,8 @@ void PlayerView::setUpWorld() {
 	light->setDir(-1.0, 0.25, 0.25);
 
 	light->setShadowMapEnabled(true);
-	light->m_shadowMap->setQualityVeryHigh();
+	applyShadowQuality();
+	shadowClock.start();
 
 	// Set up label
 	labelRates = new chai3d::cLabel(chai3d::NEW_CFONTCALIBRI20());
@@ -99,45 +210,86 @@ void PlayerView::setUpWorld() {
 	// Add objects to world
 	world->m_backgroundColor.setPurpleMediumSlateBlue();
 	world->addChild(camera);
-	world->addChild(light);
 
 	chai3d::cDirectionalLight* ambientLight = new chai3d::cDirectionalLight(world);
 	ambientLight->setEnabled(true);
 	ambientLight->setDir(1.0, 0.1, 0.1);
-	world->addChild(ambientLight);
 
 	chai3d::cPositionalLight* ambientLight2 = new chai3d::cPositionalLight(world);
 	ambientLight2->setEnabled(true);
 	ambientLight2->setLocalPos(-0.55, 0.0, 0.0);
-	world->addChild(ambientLight2);
+
+	// Lights of a shared scene only illuminate this view
+	if (scene != nullptr) {
+		scene->setFrustumCulling(true);
+		scene->addLight(light, view);
+		scene->addLight(ambientLight, view);
+		scene->addLight(ambientLight2, view);
+	}
+	else {
+		world->addChild(light);
+		world->addChild(ambientLight);
+		world->addChild(ambientLight2);
+	}
 
 	ui = new UserInterface(camera->m_frontLayer, window);
 }
 
-// Render the current view
+// Render the current view following the controller
 void PlayerView::render() {
 
+	if (controller != nullptr) {
+		render(controller->getWorldPosition());
+	}
+	else {
+		render(chai3d::cVector3d(0.0, 0.0, 0.0));
+	}
+}
+
+// Render the current view with the camera following the provided position down the track
+void PlayerView::render(const chai3d::cVector3d& followPos) {
+
 	glfwMakeContextCurrent(window);
 
+	// Created lazily because fence and timer query support are only known once GLEW is initialized
+	if (framePacer == nullptr) {
+		framePacer = new FramePacer(Constants::maxFramesInFlight);
+
+		useTimerQueries = (GLEW_ARB_timer_query != 0);
+		if (useTimerQueries) {
+			glGenQueries(numShadowQueries, shadowQueries);
+		}
+	}
+	framePacer->beginFrame();
+
+	if (scene != nullptr) {
+		scene->setActiveView(view);
+	}
+
 	if (!isMenu) {
-		chai3d::cVector3d pos = controller.getWorldPosition();
-		chai3d::cVector3d newCamPos = pos;
+		chai3d::cVector3d newCamPos = followPos;
 		newCamPos.y(0.0); newCamPos.z(0.0);
 		camera->setLocalPos(newCamPos + chai3d::cVector3d(0.1, 0.0, 0.0));
 
-		light->setLocalPos(camera->getLocalPos() + chai3d::cVector3d(0.1, -0.01, 0.01));
+		if (scene != nullptr) {
+			scene->setCullingCamera(camera, height > 0 ? (double)width / height : 1.0);
+		}
 
 		// Update haptic and graphic rate data
 		//labelRates->setText(chai3d::cStr(graphicsFreq.getFrequency(), 0) + " Hz / " +
-		//	chai3d::cStr(controller.getFrequency(), 0) + " Hz / " +
-		//	"camera pos: " + chai3d::cStr(controller.getWorldPosition().x()) + " " + chai3d::cStr(controller.getWorldPosition().y()) + " " + chai3d::cStr(controller.getWorldPosition().z()));
+		//	chai3d::cStr(controller->getFrequency(), 0) + " Hz / " +
+		//	"camera pos: " + chai3d::cStr(followPos.x()) + " " + chai3d::cStr(followPos.y()) + " " + chai3d::cStr(followPos.z()));
 		//labelRates->setLocalPos((int)(0.5 * (width - labelRates->getWidth())), 15);
 
-		// Render world
-		world->updateShadowMaps();
+		updateShadows();
+	}
+
+	if (offscreen) {
+		frameBuffer->renderView();
+	}
+	else {
+		camera->renderView(width, height);
 	}
-	camera->renderView(width, height);
-	glFinish();
 
 	// Check for any OpenGL errors
 	GLenum err;
@@ -147,7 +299,190 @@ void PlayerView::render() {
 	}
 
 	graphicsFreq.signal(1);
-	glfwSwapBuffers(window);
+	if (!offscreen) {
+		glfwSwapBuffers(window);
+	}
+	framePacer->endFrame();
+}
+
+// Saves the last offscreen frame to an image file. Returns false for onscreen views
+bool PlayerView::saveFrame(std::string filename) {
+
+	if (!offscreen) {
+		return false;
+	}
+
+	glfwMakeContextCurrent(window);
+	chai3d::cImagePtr image = chai3d::cImage::create();
+	frameBuffer->copyImageBuffer(image);
+	return image->saveToFile(filename);
+}
+
+// Re-renders the shadow map only when the light has moved past a threshold, the scene has changed or a cursor inside
+// the light's cone has moved past a threshold, otherwise the cached map is reused
+void PlayerView::updateShadows() {
+
+	lastShadowPassMs = 0.0;
+	readShadowTimes();
+
+	// The light stays where the map was rendered until the camera takes it a threshold away, then moves to its exact
+	// place rather than a grid point, so shadows shift by less than the threshold
+	chai3d::cVector3d lightPos = camera->getLocalPos() + chai3d::cVector3d(0.1, -0.01, 0.01);
+	bool lightMoved = (lightPos - shadowLightPos).length() > Constants::shadowMoveThreshold;
+	bool sceneChanged = (scene != nullptr && scene->getVersion() != shadowSceneVersion);
+	bool castersChanged = castersMoved();
+
+	if (shadowsValid && !lightMoved && !sceneChanged && !castersChanged) {
+		return;
+	}
+
+	light->setLocalPos(lightPos);
+	shadowLightPos = lightPos;
+	for (size_t i = 0; i < movingCasters.size(); i++) {
+		casterPositions[i] = movingCasters[i]->getWorldPosition();
+	}
+	if (scene != nullptr) {
+		shadowSceneVersion = scene->getVersion();
+	}
+
+	// All queries still in flight, so skip timing this pass rather than wait for one
+	bool timed = useTimerQueries && pendingShadowQueries < numShadowQueries;
+	if (timed) {
+		glBeginQuery(GL_TIME_ELAPSED, shadowQueries[nextShadowQuery]);
+	}
+	double startS = shadowClock.getCurrentTimeSeconds();
+	light->updateShadowMap();
+	if (timed) {
+		glEndQuery(GL_TIME_ELAPSED);
+		nextShadowQuery = (nextShadowQuery + 1) % numShadowQueries;
+		pendingShadowQueries++;
+	}
+	else if (!useTimerQueries) {
+		recordShadowPass((shadowClock.getCurrentTimeSeconds() - startS) * 1000.0);
+	}
+	shadowsValid = true;
+}
+
+// Returns if a cursor inside the light's cone has moved more than a threshold since the shadow map was rendered,
+// remembering the new positions. Cursors outside the cone cast no shadow into the map
+bool PlayerView::castersMoved() {
+
+	chai3d::cVector3d lightPos = light->getLocalPos();
+	chai3d::cVector3d dir = light->getDir();
+	double cosCutOff = cos(chai3d::cDegToRad(light->getCutOffAngleDeg()));
+
+	bool moved = false;
+	for (size_t i = 0; i < movingCasters.size(); i++) {
+
+		chai3d::cVector3d pos = movingCasters[i]->getWorldPosition();
+		if ((pos - casterPositions[i]).length() <= Constants::shadowCasterThreshold) {
+			continue;
+		}
+
+		// Moving within, into or out of the cone changes the map
+		chai3d::cVector3d before = casterPositions[i] - lightPos;
+		chai3d::cVector3d after = pos - lightPos;
+		bool wasInside = before.length() > 0.0 && dir.dot(before) / before.length() >= cosCutOff;
+		bool isInside = after.length() > 0.0 && dir.dot(after) / after.length() >= cosCutOff;
+		if (wasInside || isInside) {
+			moved = true;
+		}
+		casterPositions[i] = pos;
+	}
+	return moved;
+}
+
+// Takes the GPU times of finished shadow passes, oldest first, without waiting for passes still in flight
+void PlayerView::readShadowTimes() {
+
+	while (pendingShadowQueries > 0) {
+
+		int oldest = (nextShadowQuery - pendingShadowQueries + numShadowQueries) % numShadowQueries;
+		GLuint available = 0;
+		glGetQueryObjectuiv(shadowQueries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			return;
+		}
+
+		GLuint64 elapsedNs = 0;
+		glGetQueryObjectui64v(shadowQueries[oldest], GL_QUERY_RESULT, &elapsedNs);
+		pendingShadowQueries--;
+		recordShadowPass(elapsedNs / 1000000.0);
+	}
+}
+
+// Records the time of a shadow pass and adapts the shadow quality to the budget
+void PlayerView::recordShadowPass(double passMs) {
+
+	lastShadowPassMs = passMs;
+
+	// Smooth pass time so a single slow frame does not change quality
+	shadowPassMs = shadowPassMs > 0.0 ? 0.9 * shadowPassMs + 0.1 * passMs : passMs;
+
+	// Step quality down when over budget and back up when well under it
+	if (shadowPassMs > shadowBudgetMs && shadowQuality != ShadowQuality::LOW) {
+		shadowQuality = (ShadowQuality)((int)shadowQuality - 1);
+		applyShadowQuality();
+	}
+	else if (shadowPassMs < 0.25 * shadowBudgetMs && shadowQuality != maxShadowQuality) {
+		shadowQuality = (ShadowQuality)((int)shadowQuality + 1);
+		applyShadowQuality();
+	}
+}
+
+// Sets the shadow map resolution of the light to the current quality and forces a re-render
+void PlayerView::applyShadowQuality() {
+
+	switch (shadowQuality) {
+	case ShadowQuality::LOW:
+		light->m_shadowMap->setQualityLow();
+		break;
+	case ShadowQuality::MEDIUM:
+		light->m_shadowMap->setQualityMedium();
+		break;
+	case ShadowQuality::HIGH:
+		light->m_shadowMap->setQualityHigh();
+		break;
+	case ShadowQuality::VERY_HIGH:
+		light->m_shadowMap->setQualityVeryHigh();
+		break;
+	}
+	shadowsValid = false;
+}
+
+// Sets the highest shadow quality the view may use. The view starts at this quality
+void PlayerView::setShadowQuality(ShadowQuality quality) {
+
+	maxShadowQuality = quality;
+	shadowQuality = quality;
+	applyShadowQuality();
+}
+
+// Sets the time budget for a shadow pass. Quality is lowered while the pass exceeds it
+void PlayerView::setShadowBudget(double budgetMs) {
+	shadowBudgetMs = budgetMs;
+}
+
+// Returns the shadow quality currently in use
+ShadowQuality PlayerView::getShadowQuality() const {
+	return shadowQuality;
+}
+
+// Re-renders the shadow map when a player's cursor moves inside the light's cone
+void PlayerView::addMovingCaster(const HapticsController* cursor) {
+	movingCasters.push_back(cursor);
+	casterPositions.push_back(cursor->getWorldPosition());
+}
+
+// Returns the smoothed duration of a shadow pass in milliseconds
+double PlayerView::getShadowPassMs() const {
+	return shadowPassMs;
+}
+
+// Returns the GPU time in milliseconds of the shadow pass whose timing was read back this frame, zero if none was.
+// Passes are read back a few frames after they run
+double PlayerView::getLastShadowPassMs() const {
+	return lastShadowPassMs;
 }
 
 // Returns if the GLFW window should close
@@ -160,9 +495,15 @@ GLFWwindow * PlayerView::getWindow() const {
 	return window;;
 }
 
-// Adds provided mesh to the world
+// Adds provided object to the world, visible only in this view
 void PlayerView::addChild(chai3d::cGenericObject* object) {
-	world->addChild(object);
+
+	if (scene != nullptr) {
+		scene->addObject(object, view);
+	}
+	else {
+		world->addChild(object);
+	}
 }
 
 // Returns the veiw world
@@ -208,6 +549,15 @@ void PlayerView::setFullscreen(bool fullscreen) {
 	}
 }
 
+// Sets the number of vertical blanks to wait for on each buffer swap of this window
+void PlayerView::setSwapInterval(int interval) {
+
+	GLFWwindow* current = glfwGetCurrentContext();
+	glfwMakeContextCurrent(window);
+	glfwSwapInterval(interval);
+	glfwMakeContextCurrent(current);
+}
+
 // Callback for updating the size of the window
 void PlayerView::windowSizeCallback(GLFWwindow* window, int width, int height) {
 
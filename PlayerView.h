@@ -3,19 +3,33 @@
 #include "chai3d.h"
 #include <GLFW/glfw3.h>
 
+#include <cstdint>
 #include <map>
+#include <vector>
 
 #include "HapticsController.h"
 #include "UserInterface.h"
+#include "FramePacer.h"
+#include "SceneGraph.h"
+
+enum class ShadowQuality {
+	LOW,
+	MEDIUM,
+	HIGH,
+	VERY_HIGH
+};
 
 // Class that handles the view (window) of one player
 class PlayerView {
 
 public:
-	PlayerView(const HapticsController& controller, GLFWmonitor* monitor, bool fullscreen, bool isMenu=false);
+	PlayerView(const HapticsController* controller, GLFWmonitor* monitor, bool fullscreen, bool isMenu=false, SceneGraph* scene=nullptr, View view=View::BOTH);
+	PlayerView(SceneGraph* scene, View view, int width, int height);
 	virtual ~PlayerView();
 
 	void render();
+	void render(const chai3d::cVector3d& followPos);
+	bool saveFrame(std::string filename);
 	bool shouldClose() const;
 	GLFWwindow* getWindow() const;
 
@@ -29,6 +43,18 @@ public:
 	UserInterface* getUI() { return ui; };
 
 	void setFullscreen(bool fullscreen);
+	void setSwapInterval(int interval);
+	const FramePacer* getFramePacer() const { return framePacer; };
+
+	static int getShareGroup(GLFWwindow* window);
+	static GLFWwindow* getGroupWindow(int group);
+
+	void setShadowQuality(ShadowQuality quality);
+	void setShadowBudget(double budgetMs);
+	ShadowQuality getShadowQuality() const;
+	double getShadowPassMs() const;
+	double getLastShadowPassMs() const;
+	void addMovingCaster(const HapticsController* cursor);
 
 private:
 	GLFWwindow* window;
@@ -39,20 +65,60 @@ private:
 	UserInterface* ui;
 	bool isMenu;
 
+	// Shared game scene and the player this view renders for. Null for the menu, which has its own world
+	SceneGraph* scene;
+	View view;
+
 	// Graphics world and objects
 	chai3d::cWorld* world;
 	chai3d::cCamera* camera;
 	chai3d::cSpotLight* light;
 	chai3d::cLabel* labelRates;
 
-	const HapticsController& controller;
+	const HapticsController* controller;
+
+	// Offscreen views render into a framebuffer of a hidden window
+	bool offscreen;
+	chai3d::cFrameBufferPtr frameBuffer;
 
 	chai3d::cFrequencyCounter graphicsFreq;
+	FramePacer* framePacer;
+
+	// Shadow map caching. The map is re-rendered only when the light moves past a threshold, the scene changes or a
+	// cursor inside the light's cone moves past a threshold
+	ShadowQuality shadowQuality;
+	ShadowQuality maxShadowQuality;
+	double shadowBudgetMs;
+	double shadowPassMs;
+	double lastShadowPassMs;
+	bool shadowsValid;
+	chai3d::cVector3d shadowLightPos;
+	uint64_t shadowSceneVersion;
+	std::vector<const HapticsController*> movingCasters;
+	std::vector<chai3d::cVector3d> casterPositions;
+
+	// GPU time of shadow passes, read back a few frames later so the CPU never waits on the GPU. Without timer
+	// queries the CPU time of the pass is used, which only covers submitting it
+	bool useTimerQueries;
+	static const int numShadowQueries = 4;
+	GLuint shadowQueries[numShadowQueries];
+	int nextShadowQuery;
+	int pendingShadowQueries;
+	chai3d::cPrecisionClock shadowClock;
 
 	void setUpWorld();
+	void updateShadows();
+	bool castersMoved();
+	void readShadowTimes();
+	void recordShadowPass(double passMs);
+	void applyShadowQuality();
 
 	// Static members
 	static std::map<GLFWwindow*, PlayerView*> windowToView;
+	static std::map<GLFWwindow*, int> shareGroups;
+	static int nextShareGroup;
+	static void joinShareGroup(GLFWwindow* window, GLFWwindow* share);
 	static void windowSizeCallback(GLFWwindow* window, int width, int height);
+	static GLFWwindow* getShareContext();
 };
 
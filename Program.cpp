@@ -1,49 +1,68 @@
 #include "Program.h"
 
+#include <algorithm>
 #include <string>
 
 #include "InputHandler.h"
-#include "ContentReadWrite.h"
+#include "LevelBundle.h"
+#include "AssetLoader.h"
 #include "WorldLoader.h"
-#include "Hazard.h"
-#include "Collectible.h"
+#include "Constants.h"
+#include "EventBus.h"
+#include "StartupTrace.h"
+#include "TextureCache.h"
 
-HapticsController* volatile Program::next;
+// Level files in menu order, with their names and start lines
+static const std::vector<std::string> levelFiles = { "worlds/obstaclesWorld.json", "worlds/cylinderWorld.json" };
+static const std::vector<std::string> levelNames = { "Winding Coinway", "Techno Tube" };
+static const std::vector<double> levelStarts = { 0.45, 0.5 };
 
 // Default constructor for program
-Program::Program() : state(State::DEFAULT), inMenu(true), levelSelect(0) {
+Program::Program(bool hotReload, bool training) : inMenu(true), levelSelect(0), restartRequested(false), preloader(nullptr), streamer(nullptr), hotReload(hotReload), reloader(nullptr), training(training), logic(nullptr) {
 
 	fullscreen = true;
-	next = nullptr;
 	InputHandler::setUp(this);
 	printControls();
 
 	// Initialize GLFW library
-	if (!glfwInit()) {
-		std::cerr << "failed GLFW initialization" << std::endl;
-		system("pause");
-		exit(-1);
+	{
+		TracePhase phase("GLFW init");
+		if (!glfwInit()) {
+			std::cerr << "failed GLFW initialization" << std::endl;
+			system("pause");
+			exit(-1);
+		}
 	}
 	glfwSetErrorCallback(errorCallback);
 
-	// Set up haptic devices
-	world = new chai3d::cWorld();
+	// Set up haptic devices. They are first enumerated when the handler member is constructed, which shows as
+	// untraced time in the startup summary
+	world = new SceneGraph();
 	setUpHapticDevices();
 	setUpViews();
 
-	// Add cursors to the view
-	p1View->addChild(p1Haptics->getCursor());
+	// Each view shows its own cursor and a copy of the other player's
+	world->setViewMask(p1Haptics->getCursor(), View::P1);
 	p1View->addChild(p2Haptics->getCursorCopy());
 
-	p2View->addChild(p2Haptics->getCursor());
+	world->setViewMask(p2Haptics->getCursor(), View::P2);
 	p2View->addChild(p1Haptics->getCursorCopy());
 
+	// Both cursors are drawn in both views and cast shadows there
+	p1View->addMovingCaster(p1Haptics);
+	p1View->addMovingCaster(p2Haptics);
+	p2View->addMovingCaster(p1Haptics);
+	p2View->addMovingCaster(p2Haptics);
+
 	// Initialize GLEW library
-	if (glewInit() != GLEW_OK) {
-		std::cout << "failed to initialize GLEW library" << std::endl;
-		system("pause");
-		glfwTerminate();
-		exit(-1);
+	{
+		TracePhase phase("GLEW init");
+		if (glewInit() != GLEW_OK) {
+			std::cout << "failed to initialize GLEW library" << std::endl;
+			system("pause");
+			glfwTerminate();
+			exit(-1);
+		}
 	}
 
 	setUpMenu();
@@ -61,14 +80,19 @@ void Program::printControls() {
 	std::cout << "Keyboard Options:" << std::endl << std::endl;
 	std::cout << "[f] - Enable/Disable full screen mode - not working" << std::endl;
 	std::cout << "[q/esc] - Exit application" << std::endl;
+	std::cout << "[enter] - Race again from the end screen" << std::endl;
+	std::cout << "[left/right] - Change level in the menu or on the end screen" << std::endl;
 	std::cout << std::endl << std::endl;
 }
 
 // Prompts for two haptic devices to be connected then sets up the devices
 void Program::setUpHapticDevices() {
 
+	TracePhase phase("haptic devices");
 	while (handler.getNumDevices() < 2) {
 
+		TracePhase promptPhase("device prompt (waiting for input)");
+
 		std::cout << "Game requires two haptic devices to play" << std::endl;
 		std::cout << "Enter \"H\" to continue without the devices, or anything else to try again" << std::endl;
 		std::string in;
@@ -86,90 +110,191 @@ void Program::setUpHapticDevices() {
 	chai3d::cGenericHapticDevicePtr device2;
 
 	handler.getDevice(device1, 0);
-	p1Haptics = new HapticsController(device1, entities);
+	p1Haptics = new HapticsController(device1, 0, store, entityMutex);
 
 	handler.getDevice(device2, 1);
-	p2Haptics = new HapticsController(device2, entities);
+	p2Haptics = new HapticsController(device2, 1, store, entityMutex);
 
 	p1Haptics->setPartner(p2Haptics);
 	p2Haptics->setPartner(p1Haptics);
 
+	p1Haptics->setTraining(training);
+	p2Haptics->setTraining(training);
+
 	p1Haptics->setupTool(world);
 	p2Haptics->setupTool(world);
 
-	// Connect signals for haptic events
-	p1Haptics->destroyEntity.connect_member(this, &Program::destroyEntity);
-	p2Haptics->destroyEntity.connect_member(this, &Program::destroyEntity);
-
-	p1Haptics->springBroken.connect_member(this, &Program::loseGame);
+	// Game events from the haptic loops are dispatched by the game logic thread. Used up entities are removed by the
+	// main loop, which owns the scene
+	EventBus::on(EventType::ENTITY_DESTROYED).connect_member(this, &Program::handleEvent, &mainThreadCalls);
 }
 
 // Sets up a view for each player. If more than one monitor connected each view is on a seperate monitor
 void Program::setUpViews() {
 
+	TracePhase phase("player windows");
 	monitors = glfwGetMonitors(&numMonitors);
 
 	if (numMonitors < 2) {
 		std::cout << "Warning: Game best played on two monitors" << std::endl;
 		fullscreen = false;
-		p1View = new PlayerView(*p2Haptics, monitors[0], fullscreen);
+		p1View = new PlayerView(p2Haptics, monitors[0], fullscreen, false, world, View::P1);
 	}
 	else {
-		p1View = new PlayerView(*p2Haptics, monitors[1], fullscreen);
+		p1View = new PlayerView(p2Haptics, monitors[1], fullscreen, false, world, View::P1);
 	}
-	p2View = new PlayerView(*p1Haptics, monitors[0], fullscreen);
+	p2View = new PlayerView(p1Haptics, monitors[0], fullscreen, false, world, View::P2);
+
+	// Views are rendered one after another, so only the last one rendered waits for vertical sync
+	p1View->setSwapInterval(0);
+	p2View->setSwapInterval(Constants::swapInterval);
+
+	// Both views draw their shadows on the main thread every frame, so each gets half the frame's shadow budget
+	p1View->setShadowQuality((ShadowQuality)Constants::maxShadowQuality);
+	p1View->setShadowBudget(Constants::shadowBudgetMs / 2.0);
+	p2View->setShadowQuality((ShadowQuality)Constants::maxShadowQuality);
+	p2View->setShadowBudget(Constants::shadowBudgetMs / 2.0);
 }
 
 // Load level from specified file
 void Program::loadLevel() {
 
+	TracePhase phase("load level", selectedLevel);
+
+	delete streamer;
+	streamer = nullptr;
+	delete reloader;
+	reloader = nullptr;
+
+	std::unique_lock<std::recursive_mutex> lock(entityMutex);
 	for (Entity* e : entities) {
-		world->removeChild(e->mesh);
-		p1View->getWorld()->removeChild(e->mesh);
-		p2View->getWorld()->removeChild(e->mesh);
+		world->removeEntity(e);
+		forgetEntity(e);
 		delete e;
 	}
 	entities.clear();
 
-	maxTime = WorldLoader::loadWorld(ContentReadWrite::readJSON(selectedLevel), entities);
+	// Use the level loaded while the menu was shown if it finished, otherwise load it now
+	if (preloader != nullptr && preloader->take(selectedLevel, entities, maxTime)) {
+		std::cout << "Using preloaded level " << selectedLevel << std::endl;
+	}
+	else {
+		AssetLoader::resetTimings();
+		chai3d::cPrecisionClock loadClock;
+		loadClock.start(true);
+
+		rapidjson::Document d = LevelBundle::loadWorld(selectedLevel);
+		if (WorldLoader::isSegmented(d)) {
+			streamer = new WorldStreamer(d, world, entities, entityMutex);
+		}
+		maxTime = WorldLoader::loadWorld(std::move(d), entities);
+		AssetLoader::printTimings(loadClock.getCurrentTimeSeconds());
+	}
+	delete preloader;
+	preloader = nullptr;
 
+	// Add entities to the shared world, rendered only in their player's view, and to the haptic loops
+	world->addEntities(entities);
 	for (Entity* e : entities) {
+		storeEntity(e);
+	}
 
-		// Connect entity signals to the game slots
-		Type t = e->getType();
-		if (t == Type::HAZARD) {
-			Hazard* h = (Hazard*)e;
-			h->hitHazard.connect_member(this, &Program::loseGame);
-		}
-		else if (t == Type::COLLECTIBLE) {
-			Collectible* c = (Collectible*)e;
-			c->pickUpCollectible.connect_member(this, &Program::addTime);
-		}
+	// Streamed worlds own their entity list, so are not reloaded
+	if (hotReload && streamer == nullptr) {
+		reloader = new WorldReloader(selectedLevel, entities);
+	}
+	lock.unlock();
 
-		// Add entity to haptic world
-		world->addChild(e->mesh);
+	// Segments around the start are loaded now, the rest while racing
+	if (streamer != nullptr) {
+		streamer->entityLoaded.connect_member(this, &Program::storeEntity);
+		streamer->entityUnloaded.connect_member(this, &Program::forgetEntity);
+		streamer->start(startPos.x());
+	}
+}
 
-		// Add enitty to appropriate view world
-		if (e->getView() == View::P1) {
-			p1View->addChild(e->mesh);
-		}
-		else if (e->getView() == View::P2) {
-			p2View->addChild(e->mesh);
+// Rebuilds the entities whose entries changed in the world file. New entities are built first, then swapped in
+// under the entity lock so the haptic loops see the old or the new world between two of their updates
+void Program::applyReload() {
+
+	chai3d::cPrecisionClock reloadClock;
+	reloadClock.start(true);
+
+	std::vector<Entity*> current;
+	{
+		std::lock_guard<std::recursive_mutex> lock(entityMutex);
+		current = entities;
+	}
+
+	std::vector<Entity*> added;
+	std::vector<Entity*> removed;
+	double time;
+	if (!reloader->reload(current, added, removed, time)) {
+		return;
+	}
+
+	// Entities destroyed in play since the list was copied are already gone
+	std::lock_guard<std::recursive_mutex> lock(entityMutex);
+	for (Entity* e : removed) {
+
+		auto it = std::find(entities.begin(), entities.end(), e);
+		if (it == entities.end()) {
+			continue;
 		}
-		else if (e->getView() == View::BOTH) { // both
-			p1View->addChild(e->mesh);
-			p2View->addChild(e->mesh);
+		entities.erase(it);
+		world->removeEntity(e);
+		forgetEntity(e);
+		delete e;
+	}
+	for (Entity* e : added) {
+		entities.push_back(e);
+		storeEntity(e);
+	}
+	world->addEntities(added);
+	maxTime = time;
+	logic->setTimeLimit(time);
+
+	std::cout << "Reloaded " << selectedLevel << ": " << added.size() << " added, " << removed.size() << " removed in "
+		<< chai3d::cStr(reloadClock.getCurrentTimeSeconds() * 1000.0, 1) << " ms" << std::endl;
+}
+
+// Removes an entity used up in play
+void Program::handleEvent(const GameEvent& event) {
+
+	// The entity may already be gone if the level was reloaded or a segment unloaded since
+	std::lock_guard<std::recursive_mutex> lock(entityMutex);
+	for (Entity* e : entities) {
+		if (e->getId() == event.entity) {
+			destroyEntity(e);
+			break;
 		}
 	}
 }
 
+// Adds an entity joining the game to the haptic loops' store
+void Program::storeEntity(Entity* entity) {
+	store.add(entity);
+}
+
+// Removes an entity about to be deleted from the haptic loops' store
+void Program::forgetEntity(Entity* entity) {
+	store.remove(entity);
+}
+
 // Starts the program
 void Program::start() {
 
+	logic = new GameLogic(p1Haptics, p2Haptics);
+	logic->startRace(maxTime);
 	startHaptics();
 	mainLoop();
 }
 
+// Returns the state of the race as last published by the game logic
+State Program::getState() const {
+	return logic != nullptr ? logic->getSnapshot().state : State::DEFAULT;
+}
+
 // Main loop for running graphics and other non-haptics work
 void Program::mainLoop() {
 
@@ -184,53 +309,71 @@ void Program::mainLoop() {
 	p1View->setFullscreen(fullscreen);
 	p2View->setFullscreen(fullscreen);
 
-	clock.start();
-
-	state = State::RUNNING;
-
 	while (!p1View->shouldClose() && !p2View->shouldClose()) {
 
 		glfwPollEvents();
-		double timeS = clock.getCurrentTimeSeconds();
+		mainThreadCalls.dispatch();
 
-		if (state == State::RUNNING) {
-
-			if (timeS >= maxTime) {
-				loseGame();
-			}
-			else if (p1Haptics->getWorldPosition().x() < -0.5 && p2Haptics->getWorldPosition().x() < -0.5) {
-				winGame();
-			}
+		// The frame shows the latest state of the race, which advances on the logic thread
+		GameSnapshot race = logic->getSnapshot();
 
-			p1View->getUI()->setInfoLabelText(chai3d::cStr(maxTime - timeS, 1) + "s");
-			p2View->getUI()->setInfoLabelText(chai3d::cStr(maxTime - timeS, 1) + "s");
+		if (race.state == State::RUNNING) {
+			p1View->getUI()->setInfoLabelText(chai3d::cStr(race.timeLeft, 1) + "s");
+			p2View->getUI()->setInfoLabelText(chai3d::cStr(race.timeLeft, 1) + "s");
 		}
-		else if (state == State::WIN){
-			p1View->getUI()->endGame(true);
-			p2View->getUI()->endGame(true);
-			state = State::END;
+		else if (race.state == State::WIN || race.state == State::LOSE) {
+			bool win = (race.state == State::WIN);
+			p1View->getUI()->endGame(win);
+			p2View->getUI()->endGame(win);
+			logic->endRace();
 			closeHaptics();
 		}
-		else if (state == State::LOSE) {
-			p1View->getUI()->endGame(false);
-			p2View->getUI()->endGame(false);
-			state = State::END;
-			closeHaptics();
-		}
-		else if (state == State::END) {
+		else if (race.state == State::END) {
 			p1View->getUI()->updateEndScreen();
 			p2View->getUI()->updateEndScreen();
+
+			std::string next = "ENTER: race " + levelNames[levelSelect] + "   LEFT/RIGHT: change level";
+			p1View->getUI()->setInfoLabelText(next);
+			p2View->getUI()->setInfoLabelText(next);
+
+			if (restartRequested) {
+				warmRestart();
+			}
 		}
 
 		p1View->getUI()->updateInfoLabel();
 		p2View->getUI()->updateInfoLabel();
 
+		if (streamer != nullptr) {
+			streamer->update(p1Haptics->getWorldPosition().x(), p2Haptics->getWorldPosition().x());
+		}
+		if (reloader != nullptr && reloader->poll()) {
+			applyReload();
+		}
+
 		p1View->render();
 		p2View->render();
+
+		// Startup ends with the first frame of the game
+		if (StartupTrace::isRecording()) {
+			StartupTrace::finish();
+		}
 	}
 
 	// Clean up
 	closeHaptics();
+	delete logic;
+	logic = nullptr;
+	delete streamer;
+	streamer = nullptr;
+	delete reloader;
+	reloader = nullptr;
+
+	if (p1View->getFramePacer() != nullptr && p2View->getFramePacer() != nullptr) {
+		std::cout << "P1 view frame times: " << p1View->getFramePacer()->getSummary() << std::endl;
+		std::cout << "P2 view frame times: " << p2View->getFramePacer()->getSummary() << std::endl;
+	}
+	TextureCache::printMemoryUsage();
 
 	delete p1View;
 	delete p2View;
@@ -239,26 +382,15 @@ void Program::mainLoop() {
 	glfwTerminate();
 }
 
-// Called when a lose trigger is activated
-void Program::loseGame() {
-	state = State::LOSE;
-}
-
-// Called when the win trigger is activated
-void Program::winGame() {
-	state = State::WIN;
-}
-
-void Program::addTime(double amount) {
-	clock.reset(clock.getCurrentTimeSeconds() - amount);
-}
-
-// Removes entity from each view world, haptic world, and entity list
+// Removes entity from the world and entity list
 void Program::destroyEntity(Entity* entity) {
 
-	world->removeChild(entity->mesh);
-	p1View->getWorld()->removeChild(entity->mesh);
-	p2View->getWorld()->removeChild(entity->mesh);
+	std::lock_guard<std::recursive_mutex> lock(entityMutex);
+	if (streamer != nullptr) {
+		streamer->entityDestroyed(entity);
+	}
+	world->removeEntity(entity);
+	forgetEntity(entity);
 
 	std::vector<Entity*>::iterator it;
 	for (it = entities.begin(); it < entities.end(); it++) {
@@ -273,32 +405,18 @@ void Program::destroyEntity(Entity* entity) {
 
 // Called to start haptic interaction
 void Program::startHaptics() {
-
-	next = p1Haptics;
-	hapticsThread1.start(startNextHapticsLoop, chai3d::CTHREAD_PRIORITY_HAPTICS);
-
-	while (next != nullptr);
-
-	next = p2Haptics;
-	hapticsThread2.start(startNextHapticsLoop, chai3d::CTHREAD_PRIORITY_HAPTICS);
+	p1Haptics->start();
+	p2Haptics->start();
 }
 
 // Called to close and clean up program
 void Program::closeHaptics() {
 
-	// Wait for haptics loops to terminate
+	// Stop both loops together, then wait for each to finish its update
 	p1Haptics->stop();
 	p2Haptics->stop();
-	while (!p1Haptics->isFinished() && !p2Haptics->isFinished()) {
-		chai3d::cSleepMs(100);
-	}
-}
-
-// Starts the haptics controller loop of "next"
-void Program::startNextHapticsLoop() {
-	HapticsController* thread = next;
-	next = nullptr;
-	thread->start();
+	p1Haptics->join();
+	p2Haptics->join();
 }
 
 // Callback to print GLFW errors
@@ -346,8 +464,15 @@ void Program::moveCamera(double dir) {
 }
 
 void Program::menuLoop() {
-	menuView->getUI()->setupMenu();
+	{
+		TracePhase phase("menu textures");
+		menuView->getUI()->setupMenu();
+	}
 
+	// Load both levels in the background while a choice is made
+	preloader = new LevelPreloader(levelFiles);
+
+	TracePhase phase("menu (waiting for input)");
 	while (inMenu && !menuView->shouldClose()) {
 		glfwPollEvents();
 
@@ -355,21 +480,14 @@ void Program::menuLoop() {
 		menuView->render();
 	}
 
-	if (levelSelect == 0) {
-		selectedLevel = "worlds/obstaclesWorld.json";
-		p1Haptics->setPosiiton(chai3d::cVector3d(0.45, 0.01, 0.0));
-		p2Haptics->setPosiiton(chai3d::cVector3d(0.45, -0.01, 0.0));
-	}
-	else {
-		selectedLevel = "worlds/cylinderWorld.json";
-		p1Haptics->setPosiiton(chai3d::cVector3d(0.5, 0.01, 0.0));
-		p2Haptics->setPosiiton(chai3d::cVector3d(0.5, -0.01, 0.0));
-	}
+	selectLevel();
 	delete menuView;
 }
 
 void Program::setUpMenu() {
-	menuView = new PlayerView(*p1Haptics, monitors[0], fullscreen, true);
+	TracePhase phase("menu window");
+	menuView = new PlayerView(p1Haptics, monitors[0], fullscreen, true);
+	menuView->setSwapInterval(Constants::swapInterval);
 	menuView->getWorld()->m_backgroundColor.setYellowGold();
 }
 
@@ -380,27 +498,41 @@ void Program::toggleLevelSelect() {
 	else levelSelect = 0;
 }
 
+// Asks the main loop to start a new race once the end screen is shown. Called from key callbacks
 void Program::restartGame() {
+	restartRequested = true;
+}
+
+// Starts a new race of the selected level in place, keeping the devices, windows and loaded assets
+void Program::warmRestart() {
 
-	glfwSetWindowShouldClose(p1View->getWindow(), GLFW_TRUE);
+	chai3d::cPrecisionClock restartClock;
+	restartClock.start(true);
+	restartRequested = false;
 
-	//p1Haptics->setPosiiton(chai3d::cVector3d(0.55, 0.01, 0.0));
-	//p2Haptics->setPosiiton(chai3d::cVector3d(0.55, -0.01, 0.0));
+	// The haptic loops stopped when the race ended. Events they pushed since are discarded when the race starts
+	closeHaptics();
 
-	//p1Haptics->reset();
-	//p2Haptics->reset();
+	p1View->getUI()->reset();
+	p2View->getUI()->reset();
+	p1Haptics->reset();
+	p2Haptics->reset();
 
-	//p1View->getUI()->reset();
-	//p2View->getUI()->reset();
+	selectLevel();
+	loadLevel();
+
+	logic->startRace(maxTime);
+	startHaptics();
+
+	std::cout << "Restarted " << selectedLevel << " in " << chai3d::cStr(restartClock.getCurrentTimeSeconds() * 1000.0, 1) << " ms" << std::endl;
+}
 
-	//state = State::DEFAULT;
-	//inMenu = true;
-	//setUpMenu();
-	//menuLoop();
-	//loadLevel();
+// Sets the level chosen with the level select and moves both cursors to its start line
+void Program::selectLevel() {
 
-	//startHaptics();
+	selectedLevel = levelFiles[levelSelect];
+	startPos = chai3d::cVector3d(levelStarts[levelSelect], 0.0, 0.0);
 
-	//clock.reset(0.0);
-	//state = State::RUNNING;
+	p1Haptics->setPosiiton(startPos + chai3d::cVector3d(0.0, 0.01, 0.0));
+	p2Haptics->setPosiiton(startPos + chai3d::cVector3d(0.0, -0.01, 0.0));
 }
\ No newline at end of file
@@ -3,24 +3,25 @@
 #include "chai3d.h"
 #include <GLFW/glfw3.h>
 
+#include <mutex>
+
 #include "Entity.h"
+#include "EntityStore.h"
+#include "EventBus.h"
+#include "GameLogic.h"
 #include "HapticsController.h"
+#include "LevelPreloader.h"
 #include "PlayerView.h"
+#include "SceneGraph.h"
 #include "Signal.h"
-
-enum class State {
-	RUNNING,
-	WIN,
-	LOSE,
-	END,
-	DEFAULT
-};
+#include "WorldReloader.h"
+#include "WorldStreamer.h"
 
 // Main class for storing and running program
 class Program {
 
 public:
-	Program();
+	Program(bool hotReload = false, bool training = false);
 	void start();
 
 	void toggleFullscreen();
@@ -32,11 +33,14 @@ public:
 	void exitMenu() { inMenu = false; };
 	void toggleLevelSelect();
 	void restartGame();
-	State getState() { return state; };
+	State getState() const;
 
 private:
+	// Entities in play, with the data the haptic loops use kept in the store. Changes to them or the scene hold the lock
 	std::vector<Entity*> entities;
-	chai3d::cWorld* world;
+	EntityStore store;
+	std::recursive_mutex entityMutex;
+	SceneGraph* world;
 
 	PlayerView* p1View;
 	PlayerView* p2View;
@@ -49,42 +53,50 @@ private:
 	HapticsController* p1Haptics;
 	HapticsController* p2Haptics;
 
-	chai3d::cThread hapticsThread1;
-	chai3d::cThread hapticsThread2;
-
 	int numMonitors;
 	bool fullscreen;
 
 	bool inMenu;
 	int levelSelect;
+	bool restartRequested;
 
 	std::string selectedLevel;
+	LevelPreloader* preloader;
+	WorldStreamer* streamer;
+
+	// Reloads edited world files while playing when enabled
+	bool hotReload;
+	WorldReloader* reloader;
+
+	// Races without hazards, for practice
+	bool training;
+
 	chai3d::cVector3d startPos;
-	chai3d::cPrecisionClock clock;
 
-	// Game state variables
-	State state;
+	// Race rules run on their own thread. Entity removals are queued back to the main loop
+	GameLogic* logic;
+	SignalQueue mainThreadCalls;
 	double maxTime;
 
 	void printControls();
 	void setUpHapticDevices();
 	void setUpViews();
 	void loadLevel();
+	void selectLevel();
+	void warmRestart();
 	void setUpMenu();
 
 	void mainLoop();
 	void menuLoop();
-	void loseGame();
-	void winGame();
-	void addTime(double amount);
 	void destroyEntity(Entity* entity);
+	void handleEvent(const GameEvent& event);
+	void storeEntity(Entity* entity);
+	void forgetEntity(Entity* entity);
+	void applyReload();
 
 	void startHaptics();
 	void closeHaptics();
 
 	// Static members
-	static HapticsController* volatile next;
-
-	static void startNextHapticsLoop();
 	static void errorCallback(int error, const char* description);
 };
\ No newline at end of file
@@ -0,0 +1,383 @@
+#include "SceneGraph.h"
+
+#include "Constants.h"
+#include "LevelOfDetail.h"
+
+#include <algorithm>
+
+// Creates an empty scene rendering for both views
+SceneGraph::SceneGraph() : activeView(View::BOTH), version(0) {
+
+	// Culling is enabled once a view provides its camera
+	frustumCulling = false;
+	nearPlane = 0.0;
+	farPlane = 0.0;
+	tanHalfFovV = 1.0;
+	tanHalfFovH = 1.0;
+
+	trackCulling = Constants::trackCulling;
+	trackAhead = Constants::trackCullAhead;
+	trackBehind = Constants::trackCullBehind;
+
+	resetStatistics();
+}
+
+// Adds an object to the scene that is only rendered in the provided view(s)
+void SceneGraph::addObject(chai3d::cGenericObject* object, View view) {
+
+	addChild(object);
+	if (!m_children.empty() && m_children.back() == object) {
+		childIndex[object] = m_children.size() - 1;
+	}
+	viewMasks[object] = view;
+	version++;
+}
+
+// Removes an object from the scene and forgets its view mask. The last child takes the object's place, so the
+// order children are drawn in changes. Children added or removed past addObject and removeObject can move the
+// recorded position, in which case the list is searched instead
+void SceneGraph::removeObject(chai3d::cGenericObject* object) {
+
+	auto it = childIndex.find(object);
+	if (it != childIndex.end() && it->second < m_children.size() && m_children[it->second] == object) {
+
+		size_t index = it->second;
+		m_children[index] = m_children.back();
+		m_children.pop_back();
+		object->setParent(nullptr);
+
+		if (index < m_children.size()) {
+			auto moved = childIndex.find(m_children[index]);
+			if (moved != childIndex.end()) {
+				moved->second = index;
+			}
+		}
+	}
+	else {
+		removeChild(object);
+	}
+	if (it != childIndex.end()) {
+		childIndex.erase(it);
+	}
+	viewMasks.erase(object);
+	version++;
+}
+
+// Sets the view(s) an object already in the scene is rendered in
+void SceneGraph::setViewMask(chai3d::cGenericObject* object, View view) {
+	viewMasks[object] = view;
+	version++;
+}
+
+// Returns the number of times objects were added, removed or moved between views
+uint64_t SceneGraph::getVersion() const {
+	return version;
+}
+
+// Adds a light that only illuminates the provided view(s)
+void SceneGraph::addLight(chai3d::cGenericLight* light, View view) {
+	addObject(light, view);
+	lights[light] = view;
+}
+
+// Adds entities to the scene. Entities that share a mesh, texture and view with another are drawn through an
+// instance batch, their own meshes stay in the scene for haptics but are not rendered. Large meshes are drawn
+// with reduced detail levels when far from the camera
+void SceneGraph::addEntities(const std::vector<Entity*>& entities) {
+
+	std::map<std::string, int> counts;
+	for (const Entity* e : entities) {
+		if (InstanceBatch::canBatch(e->mesh)) {
+			counts[e->getMeshFile() + "|" + e->getTextureFile() + "|" + std::to_string((int)e->getView())]++;
+		}
+	}
+
+	for (Entity* e : entities) {
+
+		const std::vector<chai3d::cMultiMesh*>& levels = LevelOfDetail::getLevels(e->getMeshFile(), e->mesh);
+
+		// Entities added later, such as streamed segments, join an existing batch
+		std::string key = e->getMeshFile() + "|" + e->getTextureFile() + "|" + std::to_string((int)e->getView());
+		if (!InstanceBatch::canBatch(e->mesh) || (counts[key] < 2 && batches.count(key) == 0)) {
+			addObject(e->mesh, e->getView());
+			if (!levels.empty()) {
+				lodOf[e->mesh] = &levels;
+			}
+			continue;
+		}
+
+		InstanceBatch*& batch = batches[key];
+		if (batch == nullptr) {
+			batch = new InstanceBatch(e->mesh, levels);
+			batchKey[batch] = key;
+			addObject(batch, e->getView());
+		}
+		batch->addInstance(e->mesh);
+		batchOf[e->mesh] = batch;
+		addObject(e->mesh, View::NONE);
+	}
+}
+
+// Removes an entity's mesh from the scene and from its instance batch
+void SceneGraph::removeEntity(const Entity* entity) {
+
+	removeObject(entity->mesh);
+	lodOf.erase(entity->mesh);
+
+	auto it = batchOf.find(entity->mesh);
+	if (it == batchOf.end()) {
+		return;
+	}
+	InstanceBatch* batch = it->second;
+	batch->removeInstance(entity->mesh);
+	batchOf.erase(it);
+
+	// An empty batch is removed, freeing its GPU buffers
+	if (batch->getNumInstances() == 0) {
+		auto key = batchKey.find(batch);
+		batches.erase(key->second);
+		batchKey.erase(key);
+		removeObject(batch);
+		delete batch;
+	}
+}
+
+// Sets the view being rendered. Lights belonging to other views are switched off
+void SceneGraph::setActiveView(View view) {
+
+	activeView = view;
+
+	for (std::pair<chai3d::cGenericLight* const, View>& l : lights) {
+		l.first->setEnabled(((int)l.second & (int)view) != 0);
+	}
+}
+
+// Returns the view being rendered
+View SceneGraph::getActiveView() const {
+	return activeView;
+}
+
+// Returns if the object should be rendered in the active view
+bool SceneGraph::isVisible(const chai3d::cGenericObject* object) const {
+
+	auto it = viewMasks.find(object);
+	if (it == viewMasks.end()) {
+		return true;
+	}
+	return ((int)it->second & (int)activeView) != 0;
+}
+
+// Renders the scene skipping top level objects that are not visible in the active view or are culled. Visibility
+// flags are left untouched as the haptic loops use them for collision detection
+void SceneGraph::renderSceneGraph(chai3d::cRenderOptions& a_options) {
+
+	render(a_options);
+
+	for (chai3d::cGenericObject* child : m_children) {
+		if (!isVisible(child)) {
+			continue;
+		}
+
+		// Only meshes are culled. Cursors, lights and cameras are always rendered
+		chai3d::cMultiMesh* mesh = dynamic_cast<chai3d::cMultiMesh*>(child);
+		InstanceBatch* batch = dynamic_cast<InstanceBatch*>(child);
+		if (mesh != nullptr) {
+			renderMultiMesh(mesh, a_options);
+		}
+		else if (batch != nullptr) {
+			batch->renderInstances(a_options, *this);
+		}
+		else {
+			child->renderSceneGraph(a_options);
+		}
+	}
+}
+
+// Culls a multi mesh as a whole and then each of its meshes before rendering what remains
+void SceneGraph::renderMultiMesh(chai3d::cMultiMesh* mesh, chai3d::cRenderOptions& a_options) {
+
+	// Casters outside the camera can still shadow what it sees, so shadow passes only use the track window
+	bool testFrustum = frustumCulling && !a_options.m_creating_shadow_map;
+
+	chai3d::cTransform t = mesh->getLocalTransform();
+	chai3d::cVector3d min = mesh->getBoundaryMin();
+	chai3d::cVector3d max = mesh->getBoundaryMax();
+	chai3d::cVector3d center = t * ((min + max) * 0.5);
+	double radius = 0.5 * (max - min).length();
+
+	if (!isInsideView(center, radius, testFrustum)) {
+		culledObjects++;
+		return;
+	}
+
+	// A single mesh needs no further tests, but may be swapped for a reduced level when far away
+	int numMeshes = mesh->getNumMeshes();
+	auto lod = lodOf.find(mesh);
+	if (lod != lodOf.end()) {
+
+		const std::vector<chai3d::cMultiMesh*>& levels = *lod->second;
+		int level = selectLevel(center, radius, (int)levels.size() + 1);
+		if (level > 0) {
+
+			// Levels are shared between entities, so borrow this entity's material and texture
+			chai3d::cMultiMesh* reduced = levels[level - 1];
+			chai3d::cMesh* m = reduced->getMesh(0);
+			m->m_material = mesh->getMesh(0)->m_material;
+			m->m_texture = mesh->getMesh(0)->m_texture;
+			m->setUseTexture(mesh->getMesh(0)->getUseTexture());
+
+			glPushMatrix();
+			glMultMatrixd(t.getData());
+			reduced->renderSceneGraph(a_options);
+			glPopMatrix();
+
+			drawnObjects++;
+			drawCalls++;
+			triangles += reduced->getNumTriangles();
+			return;
+		}
+	}
+
+	if (numMeshes <= 1) {
+		mesh->renderSceneGraph(a_options);
+		drawnObjects++;
+		drawCalls += numMeshes;
+		triangles += mesh->getNumTriangles();
+		return;
+	}
+
+	glPushMatrix();
+	glMultMatrixd(t.getData());
+
+	for (int i = 0; i < numMeshes; i++) {
+
+		chai3d::cMesh* m = mesh->getMesh(i);
+		chai3d::cVector3d mMin = m->getBoundaryMin();
+		chai3d::cVector3d mMax = m->getBoundaryMax();
+
+		if (isInsideView(t * (m->getLocalTransform() * ((mMin + mMax) * 0.5)), 0.5 * (mMax - mMin).length(), testFrustum)) {
+			m->renderSceneGraph(a_options);
+			drawnObjects++;
+			drawCalls++;
+			triangles += m->getNumTriangles();
+		}
+		else {
+			culledObjects++;
+		}
+	}
+	glPopMatrix();
+}
+
+// Returns if a bounding sphere is within the track window and, if requested, the camera frustum
+bool SceneGraph::isInsideView(const chai3d::cVector3d& center, double radius, bool testFrustum) const {
+
+	if (trackCulling) {
+		if (center.x() + radius < cameraPos.x() - trackAhead || center.x() - radius > cameraPos.x() + trackBehind) {
+			return false;
+		}
+	}
+
+	if (!testFrustum) {
+		return true;
+	}
+
+	chai3d::cVector3d d = center - cameraPos;
+	double z = d.dot(cameraLook);
+	if (z + radius < nearPlane || z - radius > farPlane) {
+		return false;
+	}
+
+	// Side planes, using the distance from a point to a plane through the eye at the half field of view angle
+	double y = d.dot(cameraUp);
+	if (fabs(y) - z * tanHalfFovV > radius * sqrt(1.0 + tanHalfFovV * tanHalfFovV)) {
+		return false;
+	}
+
+	double x = d.dot(cameraRight);
+	if (fabs(x) - z * tanHalfFovH > radius * sqrt(1.0 + tanHalfFovH * tanHalfFovH)) {
+		return false;
+	}
+	return true;
+}
+
+// Returns the level of detail for a bounding sphere from its distance to the culling camera, 0 being full detail
+int SceneGraph::selectLevel(const chai3d::cVector3d& center, double radius, int numLevels) const {
+
+	double distance = std::max(0.0, (center - cameraPos).length() - radius);
+
+	int level = 2;
+	if (distance < Constants::lodNearDistance) {
+		level = 0;
+	}
+	else if (distance < Constants::lodFarDistance) {
+		level = 1;
+	}
+	return std::min(level, numLevels - 1);
+}
+
+// Sets the camera whose frustum and track position are used for culling until the next call
+void SceneGraph::setCullingCamera(const chai3d::cCamera* camera, double aspect) {
+
+	cameraPos = camera->getLocalPos();
+	cameraLook = camera->getLookVector();
+	cameraUp = camera->getUpVector();
+	cameraRight = camera->getRightVector();
+	nearPlane = camera->getNearClippingPlane();
+	farPlane = camera->getFarClippingPlane();
+
+	// The field of view angle is vertical
+	tanHalfFovV = tan(0.5 * camera->getFieldViewAngleDeg() * M_PI / 180.0);
+	tanHalfFovH = tanHalfFovV * aspect;
+}
+
+// Enables or disables culling against the camera frustum
+void SceneGraph::setFrustumCulling(bool enabled) {
+	frustumCulling = enabled;
+}
+
+// Enables or disables culling of meshes outside a window of the track around the camera
+void SceneGraph::setTrackCulling(bool enabled, double ahead, double behind) {
+	trackCulling = enabled;
+	trackAhead = ahead;
+	trackBehind = behind;
+}
+
+// Clears the draw and culling counters
+void SceneGraph::resetStatistics() {
+	drawCalls = 0;
+	triangles = 0;
+	drawnObjects = 0;
+	culledObjects = 0;
+}
+
+// Returns the number of mesh draws submitted since the last reset
+int SceneGraph::getDrawCalls() const {
+	return drawCalls;
+}
+
+// Returns the number of triangles submitted since the last reset
+int SceneGraph::getTriangles() const {
+	return triangles;
+}
+
+// Returns the number of meshes rendered since the last reset
+int SceneGraph::getDrawnObjects() const {
+	return drawnObjects;
+}
+
+// Returns the number of meshes culled since the last reset
+int SceneGraph::getCulledObjects() const {
+	return culledObjects;
+}
+
+// Adds to the draw counters. Used by instance batches that draw several objects at once
+void SceneGraph::countDrawn(int objects, int draws, int tris) {
+	drawnObjects += objects;
+	drawCalls += draws;
+	triangles += tris;
+}
+
+// Adds to the culled counter
+void SceneGraph::countCulled(int objects) {
+	culledObjects += objects;
+}
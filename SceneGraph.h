@@ -0,0 +1,95 @@
+#pragma once
+
+#include "chai3d.h"
+
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "Entity.h"
+#include "InstanceBatch.h"
+
+// World shared by the haptic loops and all player views. Each top level object carries a view mask so a
+// camera only renders the objects meant for its player
+class SceneGraph : public chai3d::cWorld {
+
+public:
+	SceneGraph();
+
+	void addObject(chai3d::cGenericObject* object, View view);
+	void removeObject(chai3d::cGenericObject* object);
+	void setViewMask(chai3d::cGenericObject* object, View view);
+	void addLight(chai3d::cGenericLight* light, View view);
+
+	void addEntities(const std::vector<Entity*>& entities);
+	void removeEntity(const Entity* entity);
+
+	void setActiveView(View view);
+	View getActiveView() const;
+	bool isVisible(const chai3d::cGenericObject* object) const;
+
+	virtual void renderSceneGraph(chai3d::cRenderOptions& a_options);
+
+	// Counts changes to the objects in the scene, so views can tell when cached renders are out of date
+	uint64_t getVersion() const;
+
+	void setCullingCamera(const chai3d::cCamera* camera, double aspect);
+	void setFrustumCulling(bool enabled);
+	void setTrackCulling(bool enabled, double ahead, double behind);
+
+	void resetStatistics();
+	int getDrawCalls() const;
+	int getTriangles() const;
+	int getDrawnObjects() const;
+	int getCulledObjects() const;
+
+	bool isInsideView(const chai3d::cVector3d& center, double radius, bool testFrustum) const;
+	void countDrawn(int objects, int draws, int tris);
+	void countCulled(int objects);
+	int selectLevel(const chai3d::cVector3d& center, double radius, int numLevels) const;
+
+private:
+	View activeView;
+	uint64_t version;
+
+	// Camera frustum used for culling
+	bool frustumCulling;
+	chai3d::cVector3d cameraPos;
+	chai3d::cVector3d cameraLook;
+	chai3d::cVector3d cameraUp;
+	chai3d::cVector3d cameraRight;
+	double nearPlane;
+	double farPlane;
+	double tanHalfFovV;
+	double tanHalfFovH;
+
+	// Range of the track kept around the camera. The camera looks down the negative x axis
+	bool trackCulling;
+	double trackAhead;
+	double trackBehind;
+
+	// Mesh draws and triangles submitted since statistics were last reset, over all passes
+	int drawCalls;
+	int triangles;
+	int drawnObjects;
+	int culledObjects;
+
+	void renderMultiMesh(chai3d::cMultiMesh* mesh, chai3d::cRenderOptions& a_options);
+
+	// Position of each object added through addObject in the child list, so it can be removed by swapping the last
+	// child into its place rather than searching the list
+	std::unordered_map<const chai3d::cGenericObject*, size_t> childIndex;
+
+	// Objects without a mask are visible in every view
+	std::unordered_map<const chai3d::cGenericObject*, View> viewMasks;
+	std::unordered_map<chai3d::cGenericLight*, View> lights;
+
+	// Batches of entities sharing a mesh, texture and view, keyed by those three
+	std::unordered_map<std::string, InstanceBatch*> batches;
+	std::unordered_map<const chai3d::cGenericObject*, InstanceBatch*> batchOf;
+	std::unordered_map<const InstanceBatch*, std::string> batchKey;
+
+	// Reduced detail levels of entity meshes drawn individually. Owned by the level of detail cache
+	std::unordered_map<const chai3d::cGenericObject*, const std::vector<chai3d::cMultiMesh*>*> lodOf;
+};
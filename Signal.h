@@ -1,72 +1,226 @@
 #pragma once
 
-// Code taken from http://simmesimme.github.io/tutorials/2015/09/20/signal-slot
+// Code based on http://simmesimme.github.io/tutorials/2015/09/20/signal-slot
 
+#include <atomic>
+#include <cstddef>
 #include <functional>
-#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Queue of slot calls emitted on other threads, run by the thread that owns the queue when it calls dispatch().
+// Connecting a slot through a queue moves the call to that thread, such as from the game logic thread to the main
+// loop
+class SignalQueue {
+
+public:
+	// adds a call to run on the next dispatch
+	void post(std::function<void()> call) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		calls_.push_back(std::move(call));
+	}
+
+	// runs the calls posted so far, in the order they were posted
+	void dispatch() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			running_.swap(calls_);
+		}
+		for (std::function<void()>& call : running_) {
+			call();
+		}
+		running_.clear();
+	}
+
+private:
+	std::mutex mutex_;
+	std::vector<std::function<void()>> calls_;
+
+	// Calls being run, kept to reuse its storage
+	std::vector<std::function<void()>> running_;
+};
+
+// Callable stored in place when small enough, as a member function pointer with its object is, so calling it
+// does not touch the heap. Larger callables are allocated once when connected
+template <typename... Args>
+class SignalSlot {
+
+public:
+	template <typename F>
+	SignalSlot(F f) {
+		construct(std::move(f), std::integral_constant<bool, fitsInline<F>()>());
+	}
+
+	SignalSlot(SignalSlot const& other) : ops_(other.ops_) {
+		ops_->copy(&buffer_, &other.buffer_);
+	}
+
+	~SignalSlot() {
+		ops_->destroy(&buffer_);
+	}
+
+	SignalSlot& operator=(SignalSlot const& other) = delete;
+
+	void operator()(Args... args) const {
+		ops_->call(&buffer_, args...);
+	}
+
+private:
+	static const size_t inlineSize = 4 * sizeof(void*);
+	typedef typename std::aligned_storage<inlineSize, alignof(std::max_align_t)>::type Buffer;
+
+	struct Ops {
+		void (*call)(const void*, Args...);
+		void (*copy)(void*, const void*);
+		void (*destroy)(void*);
+	};
+
+	Buffer buffer_;
+	const Ops* ops_;
+
+	template <typename F>
+	static constexpr bool fitsInline() {
+		return sizeof(F) <= inlineSize && alignof(F) <= alignof(Buffer) && std::is_nothrow_copy_constructible<F>::value;
+	}
+
+	// callable stored in the buffer
+	template <typename F>
+	void construct(F f, std::true_type) {
+		static const Ops ops = {
+			[](const void* b, Args... args) { (*static_cast<const F*>(b))(args...); },
+			[](void* b, const void* other) { new (b) F(*static_cast<const F*>(other)); },
+			[](void* b) { static_cast<F*>(b)->~F(); }
+		};
+		new (&buffer_) F(std::move(f));
+		ops_ = &ops;
+	}
+
+	// callable on the heap, with its pointer stored in the buffer
+	template <typename F>
+	void construct(F f, std::false_type) {
+		static const Ops ops = {
+			[](const void* b, Args... args) { (**static_cast<F* const*>(b))(args...); },
+			[](void* b, const void* other) { *static_cast<F**>(b) = new F(**static_cast<F* const*>(other)); },
+			[](void* b) { delete *static_cast<F**>(b); }
+		};
+		*reinterpret_cast<F**>(&buffer_) = new F(std::move(f));
+		ops_ = &ops;
+	}
+};
 
 // A signal object may call multiple slots with the
 // same signature. You can connect functions to the signal
 // which will be called when the emit() method on the
 // signal object is invoked. Any argument passed to emit()
 // will be passed to the given functions.
+//
+// Signals may be emitted, connected and disconnected from
+// any thread. The slot list is never changed in place:
+// connecting or disconnecting swaps in a changed copy, so
+// emit() takes a reference to the current list and calls
+// the slots without holding the signal's mutex. Taking the
+// reference is an atomic shared_ptr load, which standard
+// libraries implement with a small internal lock, and a
+// queued connection allocates the posted call. Emit is
+// therefore not for the haptic loops, which report through
+// EventBus::push into preallocated lock-free rings. A slot
+// disconnected while another thread is emitting may still
+// be called by that emit.
 
 template <typename... Args>
 class Signal {
 
 public:
 
-	Signal() : current_id_(0) {}
+	Signal() : slots_(std::make_shared<SlotList>()), current_id_(0) {}
 
 	// copy creates new signal
-	Signal(Signal const& other) : current_id_(0) {}
+	Signal(Signal const& other) : slots_(std::make_shared<SlotList>()), current_id_(0) {}
 
-	// connects a member function to this Signal
+	// connects a member function to this Signal. When a queue
+	// is given the call is run by the queue's thread instead
 	template <typename T>
-	int connect_member(T *inst, void (T::*func)(Args...)) {
+	int connect_member(T *inst, void (T::*func)(Args...), SignalQueue* queue = nullptr) const {
 		return connect([=](Args... args) {
 			(inst->*func)(args...);
-		});
+		}, queue);
 	}
 
 	// connects a const member function to this Signal
 	template <typename T>
-	int connect_member(T *inst, void (T::*func)(Args...) const) {
+	int connect_member(T *inst, void (T::*func)(Args...) const, SignalQueue* queue = nullptr) const {
 		return connect([=](Args... args) {
 			(inst->*func)(args...);
-		});
+		}, queue);
 	}
 
-	// connects a std::function to the signal. The returned
+	// connects a function object to the signal. The returned
 	// value can be used to disconnect the function again
-	int connect(std::function<void(Args...)> const& slot) const {
-		slots_.insert(std::make_pair(++current_id_, slot));
+	template <typename F>
+	int connect(F slot, SignalQueue* queue = nullptr) const {
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		std::shared_ptr<SlotList> list = std::make_shared<SlotList>(*std::atomic_load(&slots_));
+		list->push_back(Entry{ ++current_id_, SignalSlot<Args...>(std::move(slot)), queue });
+		std::atomic_store(&slots_, std::shared_ptr<const SlotList>(std::move(list)));
 		return current_id_;
 	}
 
 	// disconnects a previously connected function
 	void disconnect(int id) const {
-		slots_.erase(id);
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		std::shared_ptr<SlotList> list = std::make_shared<SlotList>();
+		for (const Entry& e : *std::atomic_load(&slots_)) {
+			if (e.id != id) {
+				list->push_back(e);
+			}
+		}
+		std::atomic_store(&slots_, std::shared_ptr<const SlotList>(std::move(list)));
 	}
 
 	// disconnects all previously connected functions
 	void disconnect_all() const {
-		slots_.clear();
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::atomic_store(&slots_, std::shared_ptr<const SlotList>(std::make_shared<SlotList>()));
 	}
 
-	// calls all connected functions
-	void emit(Args... p) {
-		for (auto it : slots_) {
-			it.second(p...);
+	// calls all connected functions, or posts the call to
+	// their queue for queued connections
+	void emit(Args... p) const {
+		std::shared_ptr<const SlotList> list = std::atomic_load(&slots_);
+
+		for (const Entry& e : *list) {
+			if (e.queue == nullptr) {
+				e.slot(p...);
+			}
+			else {
+				// The list is kept alive until the call is run
+				const SignalSlot<Args...>* slot = &e.slot;
+				e.queue->post([list, slot, p...]() { (*slot)(p...); });
+			}
 		}
 	}
 
 	// assignment creates new Signal
 	Signal& operator=(Signal const& other) {
 		disconnect_all();
+		return *this;
 	}
 
 private:
-	mutable std::map<int, std::function<void(Args...)>> slots_;
+	struct Entry {
+		int id;
+		SignalSlot<Args...> slot;
+		SignalQueue* queue;
+	};
+	typedef std::vector<Entry> SlotList;
+
+	mutable std::shared_ptr<const SlotList> slots_;
+	mutable std::mutex mutex_;
 	mutable int current_id_;
-};
\ No newline at end of file
+};
@@ -0,0 +1,250 @@
+#include "StartupTrace.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+std::atomic<bool> StartupTrace::recording(false);
+chai3d::cPrecisionClock StartupTrace::clock;
+std::string StartupTrace::chromeTraceFile;
+
+std::mutex StartupTrace::eventsMutex;
+std::vector<StartupTrace::Event> StartupTrace::events;
+std::map<std::thread::id, int> StartupTrace::threads;
+
+thread_local std::vector<const char*> TracePhase::open;
+
+// Starts recording phases. The calling thread is listed as the main thread. The Chrome trace is written when
+// recording finishes if a file is given
+void StartupTrace::start(const std::string& chromeTraceFile) {
+
+	std::lock_guard<std::mutex> lock(eventsMutex);
+	StartupTrace::chromeTraceFile = chromeTraceFile;
+	events.clear();
+	threads.clear();
+	threads[std::this_thread::get_id()] = 0;
+
+	clock.start(true);
+	recording = true;
+}
+
+// Stops recording at the first playable frame, then prints the summary and writes the Chrome trace
+void StartupTrace::finish() {
+
+	if (!recording.exchange(false)) {
+		return;
+	}
+	double totalUs = now();
+
+	std::lock_guard<std::mutex> lock(eventsMutex);
+	printSummary(totalUs);
+
+	if (!chromeTraceFile.empty()) {
+		if (writeChromeTrace(chromeTraceFile)) {
+			std::cout << "Startup trace written to " << chromeTraceFile << std::endl;
+		}
+		else {
+			std::cout << "Could not write startup trace " << chromeTraceFile << std::endl;
+		}
+	}
+}
+
+// Returns if phases are being recorded
+bool StartupTrace::isRecording() {
+	return recording;
+}
+
+// Returns the microseconds since recording started
+double StartupTrace::now() {
+	return clock.getCurrentTimeSeconds() * 1000000.0;
+}
+
+// Returns the CPU time used by the calling thread in microseconds
+double StartupTrace::threadCpuUs() {
+
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+		return 0.0;
+	}
+	unsigned long long k = ((unsigned long long)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+	unsigned long long u = ((unsigned long long)user.dwHighDateTime << 32) | user.dwLowDateTime;
+
+	// File times count 100 ns intervals
+	return (k + u) / 10.0;
+#else
+	timespec t;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t) != 0) {
+		return 0.0;
+	}
+	return t.tv_sec * 1000000.0 + t.tv_nsec / 1000.0;
+#endif
+}
+
+// Stores a finished phase, numbering threads in the order they first finish one
+void StartupTrace::record(Event event) {
+
+	std::lock_guard<std::mutex> lock(eventsMutex);
+	if (!recording) {
+		return;
+	}
+
+	std::thread::id id = std::this_thread::get_id();
+	auto it = threads.find(id);
+	if (it == threads.end()) {
+		it = threads.insert({ id, (int)threads.size() }).first;
+	}
+	event.thread = it->second;
+	events.push_back(std::move(event));
+}
+
+// Prints the phases as a table, adding up phases with the same name at the same place. Phases on other threads,
+// such as asset loading workers and the level preloader, are listed after the main thread
+void StartupTrace::printSummary(double totalUs) {
+
+	struct Row {
+		std::string label;
+		int count;
+		double wallUs;
+		double cpuUs;
+	};
+
+	std::vector<Event> sorted = events;
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Event& a, const Event& b) {
+		if ((a.thread == 0) != (b.thread == 0)) {
+			return a.thread == 0;
+		}
+		return a.startUs < b.startUs;
+	});
+
+	std::vector<Row> rows;
+	std::map<std::string, size_t> rowOf;
+	double tracedUs = 0.0;
+
+	for (const Event& e : sorted) {
+
+		std::string key = (e.thread == 0 ? "" : "background/") + e.path;
+		auto it = rowOf.find(key);
+		if (it == rowOf.end()) {
+			std::string label = (e.thread == 0 ? "" : "[bg] ") + std::string(2 * e.depth, ' ') + e.name;
+			it = rowOf.insert({ key, rows.size() }).first;
+			rows.push_back({ label, 0, 0.0, 0.0 });
+		}
+		Row& row = rows[it->second];
+		row.count++;
+		row.wallUs += e.wallUs;
+		row.cpuUs += e.cpuUs;
+
+		if (e.thread == 0 && e.depth == 0) {
+			tracedUs += e.wallUs;
+		}
+	}
+	rows.push_back({ "untraced", 1, std::max(0.0, totalUs - tracedUs), 0.0 });
+
+	std::cout << std::endl << "Startup to first playable frame: " << chai3d::cStr(totalUs / 1000.0, 1) << " ms" << std::endl;
+	std::cout << "  phase                                     count     wall ms      CPU ms   % wall" << std::endl;
+	for (const Row& row : rows) {
+
+		std::string label = row.label.substr(0, 40);
+		label.resize(42, ' ');
+		std::string count = std::to_string(row.count);
+		std::string wall = chai3d::cStr(row.wallUs / 1000.0, 1);
+		std::string cpu = chai3d::cStr(row.cpuUs / 1000.0, 1);
+		std::string percent = chai3d::cStr(totalUs > 0.0 ? 100.0 * row.wallUs / totalUs : 0.0, 1);
+
+		std::cout << "  " << label << std::string(std::max(0, 6 - (int)count.size()), ' ') << count
+		          << std::string(std::max(0, 12 - (int)wall.size()), ' ') << wall
+		          << std::string(std::max(0, 12 - (int)cpu.size()), ' ') << cpu
+		          << std::string(std::max(0, 9 - (int)percent.size()), ' ') << percent << std::endl;
+	}
+}
+
+// Writes the phases in the Chrome trace event format, one complete event per phase
+bool StartupTrace::writeChromeTrace(const std::string& filename) {
+
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+
+	writer.StartObject();
+	writer.Key("displayTimeUnit");
+	writer.String("ms");
+	writer.Key("traceEvents");
+	writer.StartArray();
+
+	for (const Event& e : events) {
+		writer.StartObject();
+		writer.Key("name");
+		writer.String((e.detail.empty() ? e.name : e.name + " " + e.detail).c_str());
+		writer.Key("cat");
+		writer.String("startup");
+		writer.Key("ph");
+		writer.String("X");
+		writer.Key("ts");
+		writer.Double(e.startUs);
+		writer.Key("dur");
+		writer.Double(e.wallUs);
+		writer.Key("pid");
+		writer.Int(1);
+		writer.Key("tid");
+		writer.Int(e.thread);
+		writer.Key("args");
+		writer.StartObject();
+		writer.Key("cpu_ms");
+		writer.Double(e.cpuUs / 1000.0);
+		writer.EndObject();
+		writer.EndObject();
+	}
+
+	writer.EndArray();
+	writer.EndObject();
+
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+	file.write(buffer.GetString(), buffer.GetSize());
+	return file.good();
+}
+
+// Opens a phase nested in the phases already open on this thread
+TracePhase::TracePhase(const char* name, const std::string& detail) : active(StartupTrace::isRecording()), name(name) {
+
+	if (!active) {
+		return;
+	}
+	this->detail = detail;
+	depth = (int)open.size();
+	for (const char* parent : open) {
+		path += parent;
+		path += "/";
+	}
+	path += name;
+	open.push_back(name);
+
+	startCpuUs = StartupTrace::threadCpuUs();
+	startUs = StartupTrace::now();
+}
+
+// Closes the phase and records its times
+TracePhase::~TracePhase() {
+
+	if (!active) {
+		return;
+	}
+	double endUs = StartupTrace::now();
+	double endCpuUs = StartupTrace::threadCpuUs();
+	open.pop_back();
+
+	StartupTrace::record({ path, name, detail, 0, depth, startUs, endUs - startUs, endCpuUs - startCpuUs });
+}
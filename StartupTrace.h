@@ -0,0 +1,72 @@
+#pragma once
+
+#include "chai3d.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Class that records the wall and CPU time of each phase from launch to the first playable frame. Phases are marked
+// with TracePhase and nest within the phases open on the same thread. A summary table is printed when recording
+// finishes, and the phases can also be written as a Chrome trace (chrome://tracing or ui.perfetto.dev)
+class StartupTrace {
+
+public:
+	static void start(const std::string& chromeTraceFile = "");
+	static void finish();
+	static bool isRecording();
+
+private:
+	friend class TracePhase;
+
+	// One finished phase. The path joins the names of the phases it is nested in
+	struct Event {
+		std::string path;
+		std::string name;
+		std::string detail;
+		int thread;
+		int depth;
+		double startUs;
+		double wallUs;
+		double cpuUs;
+	};
+
+	static std::atomic<bool> recording;
+	static chai3d::cPrecisionClock clock;
+	static std::string chromeTraceFile;
+
+	static std::mutex eventsMutex;
+	static std::vector<Event> events;
+	static std::map<std::thread::id, int> threads;
+
+	static double now();
+	static double threadCpuUs();
+	static void record(Event event);
+
+	static void printSummary(double totalUs);
+	static bool writeChromeTrace(const std::string& filename);
+};
+
+// Scoped phase of startup, timed from construction to destruction. Costs only a flag check when not recording.
+// The detail, such as a file name, appears in the Chrome trace, while the summary adds up phases by name
+class TracePhase {
+
+public:
+	TracePhase(const char* name, const std::string& detail = std::string());
+	~TracePhase();
+
+private:
+	bool active;
+	const char* name;
+	std::string detail;
+	std::string path;
+	int depth;
+	double startUs;
+	double startCpuUs;
+
+	// Names of the phases open on each thread
+	static thread_local std::vector<const char*> open;
+};
@@ -0,0 +1,158 @@
+#include "StressWorld.h"
+
+#include <fstream>
+#include <iostream>
+
+#include <rapidjson/prettywriter.h>
+#include <rapidjson/stringbuffer.h>
+
+#include "GeometryCache.h"
+
+// Start line of the track, entities are placed from here towards negative x
+static const double trackStart = 0.5;
+
+// Track every generated world uses, and its texture
+static const char* trackMesh = "models/level1.obj";
+static const char* trackTexture = "textures/level1.png";
+
+// Half the width and height of the corridor entities are placed in around the track
+static const double corridorHalfWidth = 0.025;
+
+// Writes a world with a track and the requested number of randomly placed entities
+bool StressWorld::generate(const StressSettings& settings, const std::string& filename) {
+
+	double weights[4] = { settings.viscousWeight, settings.hazardWeight, settings.collectibleWeight, settings.magnetWeight };
+	double totalWeight = weights[0] + weights[1] + weights[2] + weights[3];
+	if (totalWeight <= 0.0) {
+		std::cout << "Stress world needs at least one entity type with a positive weight" << std::endl;
+		return false;
+	}
+
+	double maxLength = maxTrackLength();
+	if (settings.trackLength <= 0.0 || settings.trackLength > maxLength) {
+		std::cout << "Stress world track length must be above 0 and at most " << maxLength << ", the length of " << trackMesh << " past the start line" << std::endl;
+		return false;
+	}
+
+	// Usual mesh and texture of each type, as in the shipped worlds
+	const char* types[4] = { "viscous", "hazard", "collectible", "magnet" };
+	const char* meshes[4] = { "models/sphere.obj", "models/bomb.obj", "models/coin.obj", "models/bar.obj" };
+	const char* textures[4] = { "textures/green.png", "textures/bomb.png", "textures/orange.png", "textures/magnet.png" };
+
+	std::mt19937 rng(settings.seed);
+
+	rapidjson::StringBuffer buffer;
+	rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(buffer);
+	writer.SetIndent('\t', 1);
+	writer.SetMaxDecimalPlaces(4);
+
+	writer.StartObject();
+	writer.Key("time");
+	writer.Double(60.0);
+	writer.Key("entities");
+	writer.StartArray();
+
+	// Track
+	writer.StartObject();
+	writer.Key("filename");
+	writer.String(trackMesh);
+	writer.Key("texture");
+	writer.String(trackTexture);
+	writer.Key("view");
+	writer.Int(3);
+	writer.EndObject();
+
+	for (int i = 0; i < settings.entityCount; i++) {
+
+		// Pick a type by weight
+		double pick = random(rng, 0.0, totalWeight);
+		int type = 0;
+		while (type < 3 && pick >= weights[type]) {
+			pick -= weights[type];
+			type++;
+		}
+
+		writer.StartObject();
+		writer.Key("filename");
+		writer.String(settings.mesh.empty() ? meshes[type] : settings.mesh.c_str());
+		writer.Key("texture");
+		writer.String(textures[type]);
+
+		writer.Key("position");
+		writer.StartObject();
+		writer.Key("x");
+		writer.Double(trackStart - random(rng, 0.0, settings.trackLength));
+		writer.Key("y");
+		writer.Double(random(rng, -corridorHalfWidth, corridorHalfWidth));
+		writer.Key("z");
+		writer.Double(random(rng, -corridorHalfWidth, corridorHalfWidth));
+		writer.EndObject();
+
+		writer.Key("rotation");
+		writer.StartObject();
+		writer.Key("x");
+		writer.Double(1.0);
+		writer.Key("y");
+		writer.Double(0.0);
+		writer.Key("z");
+		writer.Double(0.0);
+		writer.Key("deg");
+		writer.Double(random(rng, 0.0, 180.0));
+		writer.EndObject();
+
+		writer.Key("view");
+		writer.Int(3);
+		writer.Key("type");
+		writer.String(types[type]);
+
+		if (type == 0) {
+			writer.Key("damping");
+			writer.Double(40.0);
+		}
+		else if (type == 2) {
+			writer.Key("bonus");
+			writer.Double(2.0);
+		}
+		else if (type == 3) {
+			writer.Key("strength");
+			writer.Double(0.001);
+		}
+		writer.EndObject();
+	}
+
+	writer.EndArray();
+	writer.EndObject();
+
+	std::ofstream file(filename, std::ios::binary);
+	if (!file.is_open()) {
+		std::cout << "Could not write stress world " << filename << std::endl;
+		return false;
+	}
+	file.write(buffer.GetString(), buffer.GetSize());
+	return file.good();
+}
+
+// Returns the length of the track mesh past the start line, the furthest entities can be spread. Zero if the mesh
+// cannot be read
+double StressWorld::maxTrackLength() {
+
+	chai3d::cMultiMesh* track = GeometryCache::loadPrototype(trackMesh);
+	double length = 0.0;
+	if (track->getNumVertices() > 0) {
+		track->computeBoundaryBox(true);
+		length = trackStart - track->getBoundaryMin().x();
+	}
+	delete track;
+	return length;
+}
+
+// Returns the file a stress world is written to, named after its entity count and seed
+std::string StressWorld::fileFor(const StressSettings& settings) {
+	return "worlds/stress_" + std::to_string(settings.entityCount) + "_" + std::to_string(settings.seed) + ".json";
+}
+
+// Returns a uniformly distributed number in [min, max). The standard distributions differ between library
+// implementations, so the raw generator output is scaled directly to keep worlds identical across platforms
+double StressWorld::random(std::mt19937& rng, double min, double max) {
+	return min + (max - min) * (rng() / 4294967296.0);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <random>
+#include <string>
+
+// Settings for a generated stress world. Type weights need not sum to one
+struct StressSettings {
+	int entityCount = 1000;
+	unsigned int seed = 1;
+
+	// Entities are spread along the track from the start line towards negative x. The track mesh is always the one
+	// of level 1, so the length may not exceed the distance from the start line to the end of that mesh, about 0.99
+	double trackLength = 0.99;
+
+	double viscousWeight = 1.0;
+	double hazardWeight = 1.0;
+	double collectibleWeight = 1.0;
+	double magnetWeight = 1.0;
+
+	// Mesh used by every generated entity instead of each type's usual mesh, when set
+	std::string mesh;
+};
+
+// Class that writes procedurally generated world files in the WorldLoader schema for scaling tests. The same
+// settings and seed always give the same file
+class StressWorld {
+
+public:
+	static bool generate(const StressSettings& settings, const std::string& filename);
+	static std::string fileFor(const StressSettings& settings);
+	static double maxTrackLength();
+
+private:
+	static double random(std::mt19937& rng, double min, double max);
+};
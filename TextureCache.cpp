@@ -0,0 +1,101 @@
+#include "TextureCache.h"
+
+#include <iostream>
+
+std::mutex TextureCache::mutex;
+std::map<std::string, chai3d::cTexture2dPtr> TextureCache::textures;
+std::map<std::string, chai3d::cImagePtr> TextureCache::images;
+
+// Returns the mipmapped, repeating texture for an image file, creating it on first use
+chai3d::cTexture2dPtr TextureCache::getTexture(const std::string& filename) {
+
+	std::lock_guard<std::mutex> lock(mutex);
+	chai3d::cTexture2dPtr& texture = textures[filename];
+	if (texture == nullptr) {
+		texture = chai3d::cTexture2d::create();
+		texture->setImage(findOrLoadImage(filename));
+		texture->setWrapModeS(GL_REPEAT);
+		texture->setWrapModeT(GL_REPEAT);
+		texture->setUseMipmaps(true);
+	}
+	return texture;
+}
+
+// Returns the decoded image for a file, decoding it on first use
+chai3d::cImagePtr TextureCache::getImage(const std::string& filename) {
+
+	std::lock_guard<std::mutex> lock(mutex);
+	return findOrLoadImage(filename);
+}
+
+// Returns the decoded image for a file, decoding it on first use. Called with the lock held
+chai3d::cImagePtr TextureCache::findOrLoadImage(const std::string& filename) {
+
+	chai3d::cImagePtr& image = images[filename];
+	if (image == nullptr) {
+		image = chai3d::cImage::create();
+		if (!image->loadFromFile(filename)) {
+			std::cout << "Could not load image " << filename << std::endl;
+		}
+	}
+	return image;
+}
+
+// Returns if the image for a file is cached
+bool TextureCache::hasImage(const std::string& filename) {
+
+	std::lock_guard<std::mutex> lock(mutex);
+	return images.find(filename) != images.end();
+}
+
+// Adds an image decoded elsewhere, such as from a level bundle, unless the file is already cached
+void TextureCache::addImage(const std::string& filename, chai3d::cImagePtr image) {
+
+	std::lock_guard<std::mutex> lock(mutex);
+	chai3d::cImagePtr& cached = images[filename];
+	if (cached == nullptr) {
+		cached = image;
+	}
+}
+
+// Returns the GPU memory of a texture, including a third extra for mipmaps
+size_t TextureCache::textureBytes(const chai3d::cTexture2dPtr& texture) {
+
+	size_t bytes = texture->m_image->getSizeInBytes();
+	if (texture->getUseMipmaps()) {
+		bytes += bytes / 3;
+	}
+	return bytes;
+}
+
+// Returns the GPU memory used by all cached textures
+size_t TextureCache::getMemoryUsage() {
+
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t total = 0;
+	for (const std::pair<const std::string, chai3d::cTexture2dPtr>& t : textures) {
+		total += textureBytes(t.second);
+	}
+	return total;
+}
+
+// Prints the size and memory of each cached texture and decoded image
+void TextureCache::printMemoryUsage() {
+
+	std::lock_guard<std::mutex> lock(mutex);
+	std::cout << "Textures:" << std::endl;
+	size_t total = 0;
+	for (const std::pair<const std::string, chai3d::cTexture2dPtr>& t : textures) {
+		total += textureBytes(t.second);
+		chai3d::cImagePtr image = t.second->m_image;
+		std::cout << "  " << t.first << " " << image->getWidth() << "x" << image->getHeight() << ", "
+			<< chai3d::cStr(textureBytes(t.second) / 1024.0, 1) << " KB on GPU, shared by " << (t.second.use_count() - 1) << std::endl;
+	}
+
+	size_t decoded = 0;
+	for (const std::pair<const std::string, chai3d::cImagePtr>& i : images) {
+		decoded += i.second->getSizeInBytes();
+	}
+	std::cout << "  total " << chai3d::cStr(total / (1024.0 * 1024.0), 2) << " MB on GPU, "
+		<< chai3d::cStr(decoded / (1024.0 * 1024.0), 2) << " MB decoded" << std::endl;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "chai3d.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+
+// Class that decodes each image file once and shares it. Entity textures are shared so each is uploaded and has its
+// mipmaps built once, and all views draw from the same GPU copy as their OpenGL contexts share objects. The maps are
+// used by the main thread and by loader threads, so every accessor takes the cache's own lock. It is taken after
+// AssetLoader::cacheMutex and never while waiting on it, so the two cannot deadlock
+class TextureCache {
+
+public:
+	static chai3d::cTexture2dPtr getTexture(const std::string& filename);
+	static chai3d::cImagePtr getImage(const std::string& filename);
+	static bool hasImage(const std::string& filename);
+	static void addImage(const std::string& filename, chai3d::cImagePtr image);
+
+	static size_t getMemoryUsage();
+	static void printMemoryUsage();
+
+private:
+	static std::mutex mutex;
+	static std::map<std::string, chai3d::cTexture2dPtr> textures;
+	static std::map<std::string, chai3d::cImagePtr> images;
+
+	static chai3d::cImagePtr findOrLoadImage(const std::string& filename);
+	static size_t textureBytes(const chai3d::cTexture2dPtr& texture);
+};
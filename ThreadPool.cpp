@@ -0,0 +1,102 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+// Starts the worker threads
+ThreadPool::ThreadPool(int numWorkers) : task(nullptr), cancel(nullptr), count(0), next(0), remaining(0), stopping(false) {
+
+	for (int i = 0; i < numWorkers; i++) {
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+	}
+}
+
+// Stops and joins the worker threads
+ThreadPool::~ThreadPool() {
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	workReady.notify_all();
+
+	for (std::thread& t : workers) {
+		t.join();
+	}
+}
+
+// Returns a worker count leaving one hardware thread for the caller
+int ThreadPool::defaultWorkers() {
+	return std::max(0, (int)std::thread::hardware_concurrency() - 1);
+}
+
+// Returns the number of threads running loop iterations, including the caller
+int ThreadPool::getNumThreads() const {
+	return (int)workers.size() + 1;
+}
+
+// Runs task(i) for i in [0, count) across the pool and returns once all have finished. Iterations may run in any
+// order, so each should only write its own results. Once cancel is set, iterations not yet started are skipped
+void ThreadPool::parallelFor(int count, const std::function<void(int)>& task, const std::atomic<bool>* cancel) {
+
+	if (count <= 0) {
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(mutex);
+	this->task = &task;
+	this->cancel = cancel;
+	this->count = count;
+	next = 0;
+	remaining = count;
+	workReady.notify_all();
+
+	while (runNext(lock)) {}
+	workDone.wait(lock, [this] { return remaining == 0; });
+
+	this->task = nullptr;
+	this->cancel = nullptr;
+}
+
+// Runs the next iteration of the current loop, releasing the lock while it runs. Returns false if none are left
+bool ThreadPool::runNext(std::unique_lock<std::mutex>& lock) {
+
+	if (task == nullptr || next >= count) {
+		return false;
+	}
+
+	// Drop the iterations left so the loop finishes with those already running
+	if (cancel != nullptr && *cancel) {
+		remaining -= count - next;
+		next = count;
+		if (remaining == 0) {
+			workDone.notify_all();
+		}
+		return false;
+	}
+
+	int i = next++;
+	const std::function<void(int)>* current = task;
+
+	lock.unlock();
+	(*current)(i);
+	lock.lock();
+
+	if (--remaining == 0) {
+		workDone.notify_all();
+	}
+	return true;
+}
+
+// Waits for loop iterations to run until the pool is destroyed
+void ThreadPool::workerLoop() {
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+
+		workReady.wait(lock, [this] { return stopping || (task != nullptr && next < count); });
+		if (stopping) {
+			return;
+		}
+		runNext(lock);
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that run the iterations of a parallel loop. The calling thread works too, so a pool
+// of zero workers runs everything in sequence
+class ThreadPool {
+
+public:
+	ThreadPool(int numWorkers);
+	~ThreadPool();
+
+	void parallelFor(int count, const std::function<void(int)>& task, const std::atomic<bool>* cancel = nullptr);
+	int getNumThreads() const;
+
+	static int defaultWorkers();
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable workReady;
+	std::condition_variable workDone;
+
+	// Loop being run, its cancel flag, the next iteration to hand out and the iterations not yet finished
+	const std::function<void(int)>* task;
+	const std::atomic<bool>* cancel;
+	int count;
+	int next;
+	int remaining;
+	bool stopping;
+
+	void workerLoop();
+	bool runNext(std::unique_lock<std::mutex>& lock);
+};
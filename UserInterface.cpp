@@ -1,12 +1,14 @@
 #include "UserInterface.h"
 
+#include "TextureCache.h"
+
 void UserInterface::setupMenu() {
 	bg = new chai3d::cBitmap();
-	bg->loadFromFile("textures/bg.png");
+	bg->loadFromImage(TextureCache::getImage("textures/bg.png"));
 	screen->addChild(bg);
 
 	selectPanel = new chai3d::cBitmap();
-	selectPanel->loadFromFile("textures/selection.png");
+	selectPanel->loadFromImage(TextureCache::getImage("textures/selection.png"));
 	screen->addChild(selectPanel);
 
 	startLabel = new chai3d::cLabel(chai3d::NEW_CFONTCALIBRI32());
@@ -16,12 +18,12 @@ void UserInterface::setupMenu() {
 	startLabel->setText("Use arrow keys and press ENTER to select a level!");
 
 	logo = new chai3d::cBitmap();
-	logo->loadFromFile("textures/logo.png");
+	logo->loadFromImage(TextureCache::getImage("textures/logo.png"));
 	screen->addChild(logo);
 	logo->setZoom(0.5, 0.5);
 
 	level1 = new chai3d::cBitmap();
-	level1->loadFromFile("textures/coinway.png");
+	level1->loadFromImage(TextureCache::getImage("textures/coinway.png"));
 	screen->addChild(level1);
 	level1->setZoom(0.5, 0.5);
 
@@ -31,7 +33,7 @@ void UserInterface::setupMenu() {
 	level1Label->setText("Winding Coinway (easy)");
 
 	level2 = new chai3d::cBitmap();
-	level2->loadFromFile("textures/technotube.png");
+	level2->loadFromImage(TextureCache::getImage("textures/technotube.png"));
 	screen->addChild(level2);
 	level2->setZoom(0.5, 0.5);
 
@@ -82,7 +84,7 @@ void UserInterface::endGame(bool hasWin) {
 		filename = "textures/lose.png";
 	}
 
-	endScreen->loadFromFile(filename);
+	endScreen->loadFromImage(TextureCache::getImage(filename));
 	screen->addChild(endScreen);
 }
 
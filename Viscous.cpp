@@ -7,7 +7,12 @@ Viscous::Viscous(std::string filename, View view, chai3d::cTransform transform,
 	mesh->setTransparencyLevel(0.5);
 }
 
-// Returns a damping force simulating a viscous material like molasses
-chai3d::cVector3d Viscous::interact(chai3d::cToolCursor* tool) {
-	return tool->getDeviceLocalLinVel() * -damping;
+// Returns the damping coefficient
+double Viscous::getDamping() const {
+	return damping;
+}
+
+// Returns a damping force simulating a viscous material like molasses, for a cursor inside the entity
+chai3d::cVector3d Viscous::dampingForce(const chai3d::cVector3d& velocity, double damping) {
+	return velocity * -damping;
 }
@@ -8,9 +8,10 @@ class Viscous : public Entity {
 public:
 	Viscous(std::string filename, View view, chai3d::cTransform transform, double damping);
 
-	virtual chai3d::cVector3d interact(chai3d::cToolCursor* tool);
+	double getDamping() const;
+
+	static chai3d::cVector3d dampingForce(const chai3d::cVector3d& velocity, double damping);
 
 private:
 	double damping;
 };
-
@@ -6,79 +6,122 @@
 #include "Hazard.h"
 #include "Collectible.h"
 #include "Magnet.h"
+#include "AssetLoader.h"
+#include "StartupTrace.h"
 
-// Fills a vector of all entities from a world file and returns the time limit for the level
-double WorldLoader::loadWorld(rapidjson::Document d, std::vector<Entity*>& output) {
+// Fills a vector of all entities from a world file and returns the time limit for the level. Assets are loaded in
+// parallel first, so creating the entities in order only copies from the caches. If the limit stops the load, the
+// entities created so far are returned. Worlds split into segments only load their persistent entities here,
+// the rest are streamed in along the track
+double WorldLoader::loadWorld(rapidjson::Document d, std::vector<Entity*>& output, LoadLimit* limit) {
 
+	bool segmented = isSegmented(d);
+
+	std::vector<const rapidjson::Value*> toLoad;
 	rapidjson::Value& entities = d["entities"];
 	for (rapidjson::SizeType i = 0; i < entities.Size(); i++) {
+		if (!segmented || isPersistent(entities[i])) {
+			toLoad.push_back(&entities[i]);
+		}
+	}
+	{
+		TracePhase phase("prefetch assets");
+		AssetLoader::prefetch(toLoad, limit);
+	}
+
+	chai3d::cPrecisionClock clock;
+	clock.start(true);
 
-		rapidjson::Value& e = entities[i];
+	TracePhase phase("create entities");
+	for (const rapidjson::Value* e : toLoad) {
 
-		// OBJ file
-		std::string file = e["filename"].GetString();
-		
-		// Texture file
-		std::string text;
-		if (e.HasMember("texture")) {
-			text = e["texture"].GetString();
+		if (limit != nullptr && limit->stopped()) {
+			break;
 		}
+		output.push_back(createEntity(*e));
+	}
+	AssetLoader::addTime(LoadStage::ENTITIES, clock.getCurrentTimeSeconds());
 
-		// World position
-		chai3d::cVector3d position(0.0, 0.0, 0.0);
-		if (e.HasMember("position")) {
-			double x = e["position"]["x"].GetDouble();
-			double y = e["position"]["y"].GetDouble();
-			double z = e["position"]["z"].GetDouble();
+	return d["time"].GetDouble();
+}
 
-			position = chai3d::cVector3d(x, y, z);
-		}
-		//position += chai3d::cVector3d(-0.55, 0.0, 0.0);
-
-		// Rotations (angles about axis)
-		chai3d::cMatrix3d rotation;
-		rotation.identity();
-		if (e.HasMember("rotation")) {
-			double x = e["rotation"]["x"].GetDouble();
-			double y = e["rotation"]["y"].GetDouble();
-			double z = e["rotation"]["z"].GetDouble();
-			double deg = e["rotation"]["deg"].GetDouble();
-
-			rotation = chai3d::cMatrix3d(x, y, z, deg * (M_PI / 180.0));
-		}
-		chai3d::cTransform trans(position, rotation);
+// Returns if a world is split into segments along the track for streaming
+bool WorldLoader::isSegmented(const rapidjson::Document& d) {
+	return d.IsObject() && d.HasMember("segmentLength");
+}
 
-		// Player view
-		View view = (View) e["view"].GetInt();
+// Returns if an entity of a segmented world stays loaded for the whole race, such as the track itself
+bool WorldLoader::isPersistent(const rapidjson::Value& e) {
+	return e.HasMember("persistent") && e["persistent"].GetBool();
+}
 
-		std::string type = "entity";
-		if (e.HasMember("type")) {
-			type = e["type"].GetString();
-		}
-		
-		// Create entity
-		Entity* newEntity;
-		if (type == "viscous") {
-			newEntity = new Viscous(file, view, trans, e["damping"].GetDouble());
-		}
-		else if (type == "hazard") {
-			newEntity = new Hazard(file, view, trans);
-		}
-		else if (type == "collectible") {
-			newEntity = new Collectible(file, view, trans, e["bonus"].GetDouble());
-		}
-		else if (type == "magnet") {
-			newEntity = new Magnet(file, view, trans, e["strength"].GetDouble());
-		}
-		else {
-			newEntity = new Entity(file, view, trans);
-		}
+// Creates an entity from its entry in a world file
+Entity* WorldLoader::createEntity(const rapidjson::Value& e) {
+
+	// OBJ file
+	std::string file = e["filename"].GetString();
+	TracePhase phase("entity", file);
 	
-		// Set texture
-		if (e.HasMember("texture")) {
-			newEntity->setTexture(text);
-		}
-		output.push_back(newEntity);
+	// Texture file
+	std::string text;
+	if (e.HasMember("texture")) {
+		text = e["texture"].GetString();
 	}
-	return d["time"].GetDouble();
+
+	// World position
+	chai3d::cVector3d position(0.0, 0.0, 0.0);
+	if (e.HasMember("position")) {
+		double x = e["position"]["x"].GetDouble();
+		double y = e["position"]["y"].GetDouble();
+		double z = e["position"]["z"].GetDouble();
+
+		position = chai3d::cVector3d(x, y, z);
+	}
+	//position += chai3d::cVector3d(-0.55, 0.0, 0.0);
+
+	// Rotations (angles about axis)
+	chai3d::cMatrix3d rotation;
+	rotation.identity();
+	if (e.HasMember("rotation")) {
+		double x = e["rotation"]["x"].GetDouble();
+		double y = e["rotation"]["y"].GetDouble();
+		double z = e["rotation"]["z"].GetDouble();
+		double deg = e["rotation"]["deg"].GetDouble();
+
+		rotation = chai3d::cMatrix3d(x, y, z, deg * (M_PI / 180.0));
+	}
+	chai3d::cTransform trans(position, rotation);
+
+	// Player view
+	View view = (View) e["view"].GetInt();
+
+	std::string type = "entity";
+	if (e.HasMember("type")) {
+		type = e["type"].GetString();
+	}
+	
+	// Create entity
+	Entity* newEntity;
+	if (type == "viscous") {
+		newEntity = new Viscous(file, view, trans, e["damping"].GetDouble());
+	}
+	else if (type == "hazard") {
+		newEntity = new Hazard(file, view, trans);
+	}
+	else if (type == "collectible") {
+		newEntity = new Collectible(file, view, trans, e["bonus"].GetDouble());
+	}
+	else if (type == "magnet") {
+		newEntity = new Magnet(file, view, trans, e["strength"].GetDouble());
+	}
+	else {
+		newEntity = new Entity(file, view, trans);
+	}
+
+	// Set texture
+	if (e.HasMember("texture")) {
+		TracePhase texturePhase("texture", text);
+		newEntity->setTexture(text);
+	}
+	return newEntity;
 }
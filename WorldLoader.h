@@ -4,11 +4,16 @@
 
 #include <vector>
 
+#include "AssetLoader.h"
 #include "Entity.h"
 
 class WorldLoader {
 
 public:
-	static double loadWorld(rapidjson::Document d, std::vector<Entity*>& output);
+	static double loadWorld(rapidjson::Document d, std::vector<Entity*>& output, LoadLimit* limit = nullptr);
+	static Entity* createEntity(const rapidjson::Value& e);
+
+	static bool isSegmented(const rapidjson::Document& d);
+	static bool isPersistent(const rapidjson::Value& e);
 };
 
@@ -0,0 +1,144 @@
+#include "WorldReloader.h"
+
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+#include <iostream>
+#include <sys/stat.h>
+
+#include "AssetLoader.h"
+#include "ContentReadWrite.h"
+#include "WorldLoader.h"
+
+// Seconds between checks of the world file
+static const double pollIntervalS = 0.25;
+
+// Pairs the entities of a freshly loaded world with the entries of its file, which are in the same order
+WorldReloader::WorldReloader(const std::string& worldFile, const std::vector<Entity*>& entities) : worldFile(worldFile), lastPollS(0.0) {
+
+	fileStamp(worldFile, lastModified, lastSize);
+	pollClock.start(true);
+
+	rapidjson::Document d = ContentReadWrite::readJSON(worldFile);
+	if (!d.IsObject() || !d.HasMember("entities")) {
+		return;
+	}
+
+	const rapidjson::Value& list = d["entities"];
+	for (rapidjson::SizeType i = 0; i < list.Size() && i < entities.size(); i++) {
+		entryOf[entities[i]] = entryKey(list[i]);
+	}
+}
+
+// Returns true once each time the world file has been saved since the last call
+bool WorldReloader::poll() {
+
+	double timeS = pollClock.getCurrentTimeSeconds();
+	if (timeS - lastPollS < pollIntervalS) {
+		return false;
+	}
+	lastPollS = timeS;
+
+	// Size is compared too as modification times may only have one second resolution
+	long long modified, size;
+	if (!fileStamp(worldFile, modified, size) || (modified == lastModified && size == lastSize)) {
+		return false;
+	}
+	lastModified = modified;
+	lastSize = size;
+	return true;
+}
+
+// Reads the changed world file and builds entities for entries not matched by a current entity or by one used up in
+// play. Returns the new entities, the current entities whose entries are gone and the time limit. The caller swaps
+// them in. Returns false and changes nothing if the file cannot be parsed, as happens while it is still being written
+bool WorldReloader::reload(const std::vector<Entity*>& current, std::vector<Entity*>& added, std::vector<Entity*>& removed, double& time) {
+
+	rapidjson::Document d = ContentReadWrite::readJSON(worldFile);
+	if (!d.IsObject() || !d.HasMember("entities") || !d["entities"].IsArray() || !d.HasMember("time")) {
+		std::cout << "Hot reload: could not parse " << worldFile << ", keeping the current world" << std::endl;
+		return false;
+	}
+
+	// Current entities by entry text, several entities may share an entry. Entities destroyed in play since the
+	// last reload join the entries used up
+	std::map<const Entity*, std::string> live;
+	std::multimap<std::string, Entity*> unmatched;
+	for (Entity* e : current) {
+		auto it = entryOf.find(e);
+		if (it != entryOf.end()) {
+			live.insert(*it);
+			unmatched.insert(std::make_pair(it->second, e));
+		}
+	}
+	for (const std::pair<const Entity* const, std::string>& entry : entryOf) {
+		if (live.find(entry.first) == live.end()) {
+			consumedEntries.insert(entry.second);
+		}
+	}
+	entryOf.swap(live);
+
+	// Used up entries are only remembered while their text is still in the file
+	std::multiset<std::string> stillConsumed;
+
+	std::vector<const rapidjson::Value*> toCreate;
+	std::vector<std::string> createdKeys;
+	const rapidjson::Value& list = d["entities"];
+	for (rapidjson::SizeType i = 0; i < list.Size(); i++) {
+
+		std::string key = entryKey(list[i]);
+		auto match = unmatched.find(key);
+		auto consumed = consumedEntries.find(key);
+		if (match != unmatched.end()) {
+			unmatched.erase(match);
+		}
+		else if (consumed != consumedEntries.end()) {
+			consumedEntries.erase(consumed);
+			stillConsumed.insert(key);
+		}
+		else {
+			toCreate.push_back(&list[i]);
+			createdKeys.push_back(key);
+		}
+	}
+
+	consumedEntries.swap(stillConsumed);
+
+	AssetLoader::prefetch(toCreate);
+	for (size_t i = 0; i < toCreate.size(); i++) {
+		Entity* e = WorldLoader::createEntity(*toCreate[i]);
+		entryOf[e] = createdKeys[i];
+		added.push_back(e);
+	}
+
+	for (std::pair<const std::string, Entity*>& u : unmatched) {
+		removed.push_back(u.second);
+		entryOf.erase(u.second);
+	}
+
+	time = d["time"].GetDouble();
+	return true;
+}
+
+// Gets the modification time and size of a file. Returns false if it does not exist
+bool WorldReloader::fileStamp(const std::string& filename, long long& modified, long long& size) {
+
+	struct stat info;
+	if (stat(filename.c_str(), &info) != 0) {
+		modified = -1;
+		size = -1;
+		return false;
+	}
+	modified = (long long)info.st_mtime;
+	size = (long long)info.st_size;
+	return true;
+}
+
+// Returns compact text for a world entry, so entries match however the file is formatted
+std::string WorldReloader::entryKey(const rapidjson::Value& entry) {
+
+	rapidjson::StringBuffer buffer;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+	entry.Accept(writer);
+	return buffer.GetString();
+}
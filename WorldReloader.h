@@ -0,0 +1,42 @@
+#pragma once
+
+#include "chai3d.h"
+#include <rapidjson/document.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Entity.h"
+
+// Watches a loaded world file during development and works out which entities to rebuild when it changes. Each
+// entity is matched to its entry in the file by the entry's text, so only added, removed or edited entries produce
+// new entities and everything else, including the cached meshes, is kept. Entities used up in play stay gone until
+// their entry is edited. Changes are found by polling the file's modification time and size rather than with an
+// inotify watch. inotify only exists on Linux and the game mainly runs on Windows, while polling a few times a
+// second costs one stat call and behaves the same on every platform
+class WorldReloader {
+
+public:
+	WorldReloader(const std::string& worldFile, const std::vector<Entity*>& entities);
+
+	bool poll();
+	bool reload(const std::vector<Entity*>& current, std::vector<Entity*>& added, std::vector<Entity*>& removed, double& time);
+
+private:
+	std::string worldFile;
+	long long lastModified;
+	long long lastSize;
+	chai3d::cPrecisionClock pollClock;
+	double lastPollS;
+
+	// Text of the world entry each loaded entity was created from
+	std::map<const Entity*, std::string> entryOf;
+
+	// Text of the entries whose entities were used up in play, so an unrelated edit does not bring them back
+	std::multiset<std::string> consumedEntries;
+
+	static bool fileStamp(const std::string& filename, long long& modified, long long& size);
+	static std::string entryKey(const rapidjson::Value& entry);
+};
@@ -0,0 +1,275 @@
+#include "WorldStreamer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "AssetLoader.h"
+#include "Constants.h"
+#include "GeometryCache.h"
+#include "WorldLoader.h"
+
+// Splits the streamed entities of a segmented world into segments. Nothing is loaded until start
+WorldStreamer::WorldStreamer(const rapidjson::Document& world, SceneGraph* scene, std::vector<Entity*>& entities, std::recursive_mutex& entityMutex) :
+	scene(scene), entities(entities), entityMutex(entityMutex), firstWanted(0), lastWanted(-1), leadingSegment(0), stopping(false) {
+
+	this->world.CopyFrom(world, this->world.GetAllocator());
+	segmentLength = this->world["segmentLength"].GetDouble();
+
+	const rapidjson::Value& list = this->world["entities"];
+	for (rapidjson::SizeType i = 0; i < list.Size(); i++) {
+
+		if (WorldLoader::isPersistent(list[i])) {
+			continue;
+		}
+		double x = list[i].HasMember("position") ? list[i]["position"]["x"].GetDouble() : 0.0;
+
+		Segment& segment = segments[segmentIndex(x)];
+		segment.entries.push_back(i);
+		segment.state = SegmentState::UNLOADED;
+		segment.estimatedBytes = 0;
+	}
+}
+
+// Stops the loading thread and deletes segments that were never published. Published entities belong to the
+// entity list
+WorldStreamer::~WorldStreamer() {
+
+	{
+		std::lock_guard<std::mutex> lock(streamMutex);
+		stopping = true;
+	}
+	wakeLoader.notify_all();
+	if (loader.joinable()) {
+		loader.join();
+	}
+
+	for (std::pair<const int, Segment>& s : segments) {
+		if (s.second.state == SegmentState::READY) {
+			for (Entity* e : s.second.entities) {
+				delete e;
+			}
+		}
+	}
+}
+
+// Loads the segments around the start position before the race, then starts streaming
+void WorldStreamer::start(double startX) {
+
+	setWanted(startX, startX);
+
+	for (std::pair<const int, Segment>& s : segments) {
+		if (isWanted(s.first)) {
+
+			std::vector<Entity*> built;
+			size_t bytes;
+			buildSegment(s.second, built, bytes);
+
+			std::lock_guard<std::recursive_mutex> entityLock(entityMutex);
+			std::lock_guard<std::mutex> lock(streamMutex);
+			s.second.entities = built;
+			s.second.estimatedBytes = bytes;
+			publish(s.first);
+		}
+	}
+
+	loader = std::thread(&WorldStreamer::loaderLoop, this);
+}
+
+// Called each frame with the player positions. Publishes finished segments in range and unloads those left behind
+void WorldStreamer::update(double p1X, double p2X) {
+
+	setWanted(p1X, p2X);
+	wakeLoader.notify_all();
+
+	// The caches are busy while a segment loads, so wait for the next frame rather than stall the haptic loops
+	std::unique_lock<std::mutex> cacheLock(AssetLoader::cacheMutex, std::try_to_lock);
+	if (!cacheLock.owns_lock()) {
+		return;
+	}
+
+	std::lock_guard<std::recursive_mutex> entityLock(entityMutex);
+	std::lock_guard<std::mutex> lock(streamMutex);
+
+	for (std::pair<const int, Segment>& s : segments) {
+
+		Segment& segment = s.second;
+		if (segment.state == SegmentState::READY && isWanted(s.first)) {
+			publish(s.first);
+		}
+		else if (segment.state == SegmentState::RESIDENT && !isWanted(s.first)) {
+			unload(segment);
+		}
+		else if (segment.state == SegmentState::READY) {
+			for (Entity* e : segment.entities) {
+				delete e;
+			}
+			segment.entities.clear();
+			segment.state = SegmentState::UNLOADED;
+		}
+	}
+}
+
+// Forgets an entity the game destroyed, so unloading its segment does not delete it again. Called with the entity
+// lock held
+void WorldStreamer::entityDestroyed(const Entity* entity) {
+
+	std::lock_guard<std::mutex> lock(streamMutex);
+
+	auto it = segmentOf.find(entity);
+	if (it == segmentOf.end()) {
+		return;
+	}
+
+	std::vector<Entity*>& list = segments[it->second].entities;
+	list.erase(std::remove(list.begin(), list.end(), entity), list.end());
+	segmentOf.erase(it);
+}
+
+// Returns the number of segments currently in the scene
+int WorldStreamer::getResidentSegments() const {
+
+	std::lock_guard<std::mutex> lock(streamMutex);
+
+	int count = 0;
+	for (const std::pair<const int, Segment>& s : segments) {
+		if (s.second.state == SegmentState::RESIDENT) {
+			count++;
+		}
+	}
+	return count;
+}
+
+// Returns the segment holding an x position
+int WorldStreamer::segmentIndex(double x) const {
+	return (int)std::floor(x / segmentLength);
+}
+
+// Sets the range of segments to keep from the player positions. Players move towards negative x
+void WorldStreamer::setWanted(double p1X, double p2X) {
+
+	double leading = std::min(p1X, p2X);
+	double trailing = std::max(p1X, p2X);
+
+	std::lock_guard<std::mutex> lock(streamMutex);
+	firstWanted = segmentIndex(leading - Constants::streamAhead);
+	lastWanted = segmentIndex(trailing + Constants::streamBehind);
+	leadingSegment = segmentIndex(leading);
+}
+
+// Returns if a segment is in the wanted range. Called with the stream lock held
+bool WorldStreamer::isWanted(int index) const {
+	return index >= firstWanted && index <= lastWanted;
+}
+
+// Returns if loading a segment keeps the loaded segments within the memory budget. The segments the players are in
+// are always allowed. Called with the stream lock held
+bool WorldStreamer::inBudget(int index) const {
+
+	if (index >= leadingSegment) {
+		return true;
+	}
+
+	size_t used = 0;
+	for (const std::pair<const int, Segment>& s : segments) {
+		if (s.second.state != SegmentState::UNLOADED) {
+			used += s.second.estimatedBytes;
+		}
+	}
+	return used / (1024.0 * 1024.0) < Constants::streamBudgetMB;
+}
+
+// Finds the wanted segment to load next, nearest the leading player first. Called with the stream lock held
+bool WorldStreamer::findNextSegment(int& index) const {
+
+	bool found = false;
+	for (const std::pair<const int, Segment>& s : segments) {
+
+		if (s.second.state != SegmentState::UNLOADED || !isWanted(s.first) || !inBudget(s.first)) {
+			continue;
+		}
+		if (!found || std::abs(s.first - leadingSegment) < std::abs(index - leadingSegment)) {
+			index = s.first;
+			found = true;
+		}
+	}
+	return found;
+}
+
+// Creates the entities of a segment, loading their assets first. Only reads the segment's entries, which never change.
+// The segment is charged for the prototypes it added to the geometry cache, so entities sharing a mesh count it once
+void WorldStreamer::buildSegment(const Segment& segment, std::vector<Entity*>& built, size_t& bytes) {
+
+	std::lock_guard<std::mutex> cacheLock(AssetLoader::cacheMutex);
+	size_t cachedBefore = GeometryCache::getMemoryUsage();
+
+	std::vector<const rapidjson::Value*> entries;
+	for (rapidjson::SizeType i : segment.entries) {
+		entries.push_back(&world["entities"][i]);
+	}
+	AssetLoader::prefetch(entries);
+
+	for (const rapidjson::Value* e : entries) {
+		built.push_back(WorldLoader::createEntity(*e));
+	}
+	bytes = GeometryCache::getMemoryUsage() - cachedBefore;
+}
+
+// Adds a ready segment to the scene and the entity list. Called with the entity and stream locks held
+void WorldStreamer::publish(int index) {
+
+	Segment& segment = segments[index];
+	for (Entity* e : segment.entities) {
+		entities.push_back(e);
+		segmentOf[e] = index;
+		entityLoaded.emit(e);
+	}
+	scene->addEntities(segment.entities);
+
+	segment.state = SegmentState::RESIDENT;
+}
+
+// Removes a segment from the scene and entity list and deletes its entities. Called with the entity and stream
+// locks held
+void WorldStreamer::unload(Segment& segment) {
+
+	for (Entity* e : segment.entities) {
+
+		scene->removeEntity(e);
+		entities.erase(std::remove(entities.begin(), entities.end(), e), entities.end());
+		segmentOf.erase(e);
+
+		entityUnloaded.emit(e);
+		delete e;
+	}
+	segment.entities.clear();
+	segment.estimatedBytes = 0;
+	segment.state = SegmentState::UNLOADED;
+}
+
+// Builds wanted segments one at a time until stopped
+void WorldStreamer::loaderLoop() {
+
+	std::unique_lock<std::mutex> lock(streamMutex);
+	while (true) {
+
+		int index = 0;
+		wakeLoader.wait(lock, [this, &index] { return stopping || findNextSegment(index); });
+		if (stopping) {
+			return;
+		}
+
+		Segment& segment = segments[index];
+		segment.state = SegmentState::LOADING;
+		lock.unlock();
+
+		std::vector<Entity*> built;
+		size_t bytes;
+		buildSegment(segment, built, bytes);
+
+		lock.lock();
+		segment.entities = built;
+		segment.estimatedBytes = bytes;
+		segment.state = SegmentState::READY;
+	}
+}
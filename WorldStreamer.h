@@ -0,0 +1,82 @@
+#pragma once
+
+#include <rapidjson/document.h>
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Entity.h"
+#include "SceneGraph.h"
+#include "Signal.h"
+
+// Streams the entities of a segmented world in and out along the track. The world's "segmentLength" splits the x axis
+// into segments, and each entity that is not "persistent" belongs to the segment holding its position. Segments ahead
+// of the leading player are built on a background thread under a memory budget, and join the scene and entity list
+// on the main thread only once complete, so the haptic loops never see part of a segment. Segments behind the
+// trailing player are removed
+class WorldStreamer {
+
+public:
+	WorldStreamer(const rapidjson::Document& world, SceneGraph* scene, std::vector<Entity*>& entities, std::recursive_mutex& entityMutex);
+	~WorldStreamer();
+
+	void start(double startX);
+	void update(double p1X, double p2X);
+	void entityDestroyed(const Entity* entity);
+
+	int getResidentSegments() const;
+
+	// Emitted with the entity lock held when a streamed entity joins the game and just before one is deleted
+	Signal<Entity*> entityLoaded;
+	Signal<Entity*> entityUnloaded;
+
+private:
+	enum class SegmentState {
+		UNLOADED,
+		LOADING,
+		READY,
+		RESIDENT
+	};
+
+	struct Segment {
+		std::vector<rapidjson::SizeType> entries;
+		std::vector<Entity*> entities;
+		SegmentState state;
+		size_t estimatedBytes;
+	};
+
+	// Copy of the world, as the segments refer to its entries
+	rapidjson::Document world;
+	double segmentLength;
+
+	SceneGraph* scene;
+	std::vector<Entity*>& entities;
+	std::recursive_mutex& entityMutex;
+
+	// Segment states and the range of segments wanted, shared with the loading thread
+	mutable std::mutex streamMutex;
+	std::condition_variable wakeLoader;
+	std::map<int, Segment> segments;
+	std::unordered_map<const Entity*, int> segmentOf;
+	int firstWanted;
+	int lastWanted;
+	int leadingSegment;
+	bool stopping;
+
+	std::thread loader;
+
+	int segmentIndex(double x) const;
+	void setWanted(double p1X, double p2X);
+	bool isWanted(int index) const;
+	bool inBudget(int index) const;
+	bool findNextSegment(int& index) const;
+	void buildSegment(const Segment& segment, std::vector<Entity*>& built, size_t& bytes);
+	void publish(int index);
+	void unload(Segment& segment);
+	void loaderLoop();
+};
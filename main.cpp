@@ -1,7 +1,146 @@
 #include "Program.h"
+#include "Benchmark.h"
+#include "EventBus.h"
+#include "ForceTuning.h"
+#include "LevelBundle.h"
+#include "MeshFile.h"
+#include "StartupTrace.h"
+#include "StressWorld.h"
 
-int main() {
-	Program p;
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+
+	std::vector<std::string> levels = { "worlds/obstaclesWorld.json", "worlds/cylinderWorld.json" };
+
+	// Offline mesh converter: application --compile-meshes. Meshes are otherwise compiled the first time they load
+	if (argc > 1 && std::string(argv[1]) == "--compile-meshes") {
+		return MeshFile::compileWorlds(levels) == 0 ? 0 : 1;
+	}
+
+	// Level bundle compiler: application --compile-levels. Stale bundles are otherwise rebuilt when a level loads
+	if (argc > 1 && std::string(argv[1]) == "--compile-levels") {
+		bool ok = true;
+		for (const std::string& level : levels) {
+			ok = LevelBundle::compile(level) && ok;
+		}
+		return ok ? 0 : 1;
+	}
+
+	// Offscreen rendering benchmark: application --benchmark [--dump-frames]
+	if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+
+		bool dumpFrames = (argc > 2 && std::string(argv[2]) == "--dump-frames");
+		Benchmark::run(levels, dumpFrames);
+		return 0;
+	}
+
+	// Stress world generator and scaling benchmark:
+	//   application --generate-stress <count> [options]
+	//   application --benchmark-stress [options]
+	// with options --seed <n>, --length <track length>, --mix <viscous>,<hazard>,<collectible>,<magnet>, --mesh <file>
+	if (argc > 1 && (std::string(argv[1]) == "--generate-stress" || std::string(argv[1]) == "--benchmark-stress")) {
+
+		bool generate = std::string(argv[1]) == "--generate-stress";
+		int first = 2;
+
+		StressSettings settings;
+		if (generate) {
+			if (argc < 3) {
+				std::cout << "usage: application --generate-stress <count> [options]" << std::endl;
+				return 1;
+			}
+			settings.entityCount = std::atoi(argv[2]);
+			first = 3;
+		}
+
+		for (int i = first; i + 1 < argc; i += 2) {
+			std::string option = argv[i];
+			if (option == "--seed") {
+				settings.seed = (unsigned int)std::strtoul(argv[i + 1], nullptr, 10);
+			}
+			else if (option == "--length") {
+				settings.trackLength = std::atof(argv[i + 1]);
+			}
+			else if (option == "--mix") {
+				std::sscanf(argv[i + 1], "%lf,%lf,%lf,%lf", &settings.viscousWeight, &settings.hazardWeight,
+				            &settings.collectibleWeight, &settings.magnetWeight);
+			}
+			else if (option == "--mesh") {
+				settings.mesh = argv[i + 1];
+			}
+			else {
+				std::cout << "unknown option " << option << std::endl;
+				return 1;
+			}
+		}
+
+		if (generate) {
+			std::string file = StressWorld::fileFor(settings);
+			if (!StressWorld::generate(settings, file)) {
+				return 1;
+			}
+			std::cout << "wrote " << file << std::endl;
+			return 0;
+		}
+		Benchmark::runStress(settings, "stress_benchmark.csv");
+		return 0;
+	}
+
+	// Event log reader: application --print-events <file>
+	if (argc > 2 && std::string(argv[1]) == "--print-events") {
+
+		std::vector<GameEvent> events;
+		if (!EventBus::readLog(argv[2], events)) {
+			return 1;
+		}
+		for (const GameEvent& e : events) {
+			std::cout << (e.tick / 1000.0) << " ms\t" << EventBus::typeName(e.type) << "\tentity " << e.entity << "\tvalue " << e.value << std::endl;
+		}
+		return 0;
+	}
+
+	// Game options:
+	//   --hot-reload              reload edited world files while playing
+	//   --startup-trace <file>    also write the startup phases as a Chrome trace
+	//   --event-log <file>        append every game event to a binary log
+	//   --training                race without hazards
+	//   --tuning <file>           read spring and rate control tunables from a JSON file (tuning builds only)
+	bool hotReload = false;
+	bool training = false;
+	std::string traceFile;
+	for (int i = 1; i < argc; i++) {
+		std::string option = argv[i];
+		if (option == "--hot-reload") {
+			hotReload = true;
+		}
+		else if (option == "--startup-trace" && i + 1 < argc) {
+			traceFile = argv[++i];
+		}
+		else if (option == "--event-log" && i + 1 < argc) {
+			EventBus::openLog(argv[++i]);
+		}
+		else if (option == "--training") {
+			training = true;
+		}
+		else if (option == "--tuning" && i + 1 < argc) {
+#ifdef TUNING_BUILD
+			RuntimeTuning::load(argv[++i]);
+#else
+			std::cout << "--tuning needs a build with TUNING_BUILD defined" << std::endl;
+			i++;
+#endif
+		}
+	}
+
+	// Startup phases are timed up to the first frame of the game and summarized
+	StartupTrace::start(traceFile);
+
+	Program p(hotReload, training);
 	p.start();
 	return 0;
-}
\ No newline at end of file
+}